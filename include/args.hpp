@@ -45,6 +45,8 @@ enum
     OP_TEST_COLORS,
     OP_RECURSIVE,
     OP_NOSAVE,
+    OP_CHECK_UPDATES,
+    OP_JSON,
 };
 
 struct Operation_t
@@ -64,6 +66,8 @@ struct Operation_t
     u_short version;
     u_short test_colors;
     u_short show_recipe;
+    u_short check_updates;
+    u_short json;
 };
 
 inline struct Operation_t      op;
@@ -0,0 +1,20 @@
+#ifndef BUILDCACHE_HPP
+#define BUILDCACHE_HPP
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using std::filesystem::path;
+
+/* The build cache keeps the packages we built in config->buildCacheDir, in a folder named after the hash of
+ * everything that went into them (see build_cache_key()), so building the exact same recipe again, here or on another
+ * machine sharing that folder, is only a copy.
+ */
+
+std::string build_cache_key(const std::string_view pkg_name, const path& pkg_dir);
+bool        restore_cached_build(const std::string_view key, const path& pkg_dir);
+bool        store_cached_build(const std::string_view key, const std::vector<std::string>& artifacts);
+
+#endif
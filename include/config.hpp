@@ -49,9 +49,12 @@ class Config
 public:
     alpm_handle_t*           handle = nullptr;
     alpm_list_t*             repos  = nullptr;
+    // get_db_state() when the dbs were registered, libalpm's view of them is never newer than this
+    std::string              dbStateAtLoad;
     std::string              makepkgBin;
     std::vector<std::string> editor;
     path                     cacheDir;
+    path                     buildCacheDir;
     std::string              pmConfig;
     std::string              sudo;
     std::string              git;
@@ -63,8 +66,24 @@ public:
     bool                     debug;
     bool                     quiet;
     bool                     noconfirm;
+    bool                     localMetadata;
+    bool                     buildCache;
+    // how long, in seconds, cached AUR RPC responses are considered fresh
+    std::int64_t rpcCacheTTL;
+    // how old, in hours, packages.aur can get before we check for a new one
+    std::int64_t aurListMaxAge;
+    // the longest url, in bytes, we send to the AUR RPC, longer package lists get split into many requests
+    std::int64_t rpcMaxUrlLength;
+    // how many AUR packages can be built at the same time
+    std::int64_t buildJobs;
+    // how many AUR packages and their sources can be downloaded at the same time
+    std::int64_t fetchJobs;
+    // how old, in hours, the local AUR metadata can get before we check for a new one
+    std::int64_t metadataMaxAge;
     // alpm transaction flags
     int flags;
+    // set by --check-updates, nothing gets written to the cache dir
+    bool readOnly = false;
 
     Config(const std::string_view configFile, const std::string_view themeFile, const std::string_view configDir);
     ~Config();
@@ -132,6 +151,42 @@ inline constexpr std::string_view AUTOCONFIG = R"#([general]
 # Where we are gonna download the AUR packages (default $XDG_CACHE_HOME/TabAUR, else ~/.cache/TabAUR)
 #cacheDir = "$XDG_CACHE_HOME/TabAUR"
 
+# How long (in seconds) AUR search and package info results are reused before asking the AUR again.
+# They are stored in the ".rpc" folder inside cacheDir, 0 disables the cache.
+#rpcCacheTTL = 300
+
+# How old (in hours) the list of AUR packages can get before checking for a new one.
+# Checking is cheap, the list is only downloaded again if it changed. A negative value never refreshes it.
+#aurListMaxAge = 24
+
+# The longest URL (in bytes) sent when asking the AUR about many packages at once.
+# Longer lists of packages are split into several requests, sent at the same time.
+#rpcMaxUrlLength = 4000
+
+# How many AUR packages can be built at the same time, packages that depend on each other are still built in order.
+# Each build writes its output to "taur-build.log" inside its folder when this is more than 1.
+#buildJobs = 1
+
+# How many AUR packages, and then their sources, can be downloaded at the same time, before building anything.
+# Source downloads write their output to "taur-build.log" inside the package folder when this is more than 1.
+#fetchJobs = 4
+
+# If true, AUR searches and package info are answered from a local copy of all the AUR's metadata,
+# instead of asking the AUR each time. It's downloaded into cacheDir, "taur -Sy" refreshes it.
+# A copy of packages-meta-ext-v1.json.gz put in cacheDir by hand works too, e.g on machines that can't reach the AUR.
+#localMetadata = false
+
+# How old (in hours) the local AUR metadata can get before checking for a new one.
+# Packages missing from it are looked up on the AUR.
+# A negative value never refreshes it nor asks the AUR, for machines that can't reach it.
+#metadataMaxAge = 24
+
+# If true, every package we build is kept in buildCacheDir, under a hash of its PKGBUILD, .SRCINFO, local sources
+# and makepkg.conf, and building the exact same recipe again only copies it from there.
+# VCS (-git, ...) packages are never cached. buildCacheDir can be shared by many machines, e.g over NFS.
+#buildCache = false
+#buildCacheDir = "$XDG_CACHE_HOME/TabAUR/.build-cache"
+
 [bins]
 #makepkg = "makepkg"
 #git = "git"
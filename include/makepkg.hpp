@@ -0,0 +1,69 @@
+#ifndef MAKEPKG_HPP
+#define MAKEPKG_HPP
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using std::filesystem::path;
+
+// "key = value" pairs of a .SRCINFO section, each key can be there many times, e.g depends or source_x86_64
+using SrcinfoValues = std::unordered_map<std::string, std::vector<std::string>>;
+
+/** What a .SRCINFO says about a package base and the packages it builds, see parse_srcinfo().
+ * It's what makepkg --printsrcinfo prints, so we know everything about a PKGBUILD without running bash.
+ */
+struct Srcinfo_t
+{
+    std::string              pkgbase;
+    std::vector<std::string> pkgnames;
+
+    // the values of the pkgbase, which every package has unless it overrides them
+    SrcinfoValues values;
+    // the values each package overrides, e.g overrides["foo-docs"]["arch"]
+    std::unordered_map<std::string, SrcinfoValues> overrides;
+
+    std::string_view                get(const std::string& key) const;
+    std::vector<std::string>        getList(const std::string& key, const std::string_view arch = {}) const;
+    const std::vector<std::string>& getPkgList(const std::string& pkgname, const std::string& key) const;
+    std::string                     version() const;
+};
+
+/** makepkg's configuration, loaded the way makepkg loads it: makepkg.conf, then the drop-ins in makepkg.conf.d,
+ * then the user's makepkg.conf, then the environment variables makepkg lets override it (PKGDEST, PKGEXT, ...).
+ * The files are bash, only the assignments in them are read, e.g KEY=value, KEY+="value" and KEY=(a b c).
+ */
+class MakepkgConf
+{
+public:
+    bool load(const path& conf_path);
+    void parse(const std::string_view text);
+
+    std::string_view                get(const std::string& key) const;
+    const std::vector<std::string>& getList(const std::string& key) const;
+    const std::string&              fingerprint() const { return fingerprintHash; }
+
+private:
+    SrcinfoValues values;
+    // a hash of everything that was loaded, so we can tell when the configuration changes
+    std::string fingerprintHash;
+
+    bool        loadFile(const path& file_path, std::string& hashes);
+    std::string readWord(const std::string_view text, size_t& i) const;
+    std::string readVariable(const std::string_view text, size_t& i) const;
+};
+
+std::optional<Srcinfo_t> parse_srcinfo(const std::string_view text);
+std::optional<Srcinfo_t> parse_srcinfo_file(const path& file_path);
+std::optional<Srcinfo_t> get_srcinfo(const path& pkg_dir);
+bool                     is_vcs_source(const std::string_view source);
+bool                     has_vcs_sources(const Srcinfo_t& srcinfo);
+const MakepkgConf&       get_makepkg_conf();
+
+std::optional<std::vector<std::string>> get_packagelist(const path& pkg_dir);
+std::string_view                        package_file_pkgname(std::string_view file);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef METADATA_HPP
+#define METADATA_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "taur.hpp"
+
+using std::filesystem::path;
+
+// every AUR package with its full information, updated by the AUR every few minutes
+#define AUR_METADATA_URL AUR_URL "/packages-meta-ext-v1.json.gz"
+#define AUR_METADATA_FILE "packages-meta-ext-v1.json.gz"
+#define AUR_METADATA_STORE "packages-meta.idx"
+
+/** A local copy of the AUR's metadata, memory-mapped from the store write_aur_metadata() makes out of
+ * packages-meta-ext-v1.json.gz, so searches and package info don't need to ask the AUR.
+ * The store is an array of count+1 offsets followed by the packages, sorted by name,
+ * and an index of the words in their names and descriptions.
+ */
+class AurMetadata
+{
+public:
+    AurMetadata() = default;
+    ~AurMetadata();
+
+    // it owns its mapping, a copy would unmap it a second time
+    AurMetadata(const AurMetadata&)            = delete;
+    AurMetadata& operator=(const AurMetadata&) = delete;
+
+    bool                                  load(const path& store_path);
+    std::optional<TaurPkg_t>              find(const std::string_view name, const bool useGit) const;
+    std::optional<std::vector<TaurPkg_t>> search(const std::string_view query, const std::string_view searchBy,
+                                                 const bool useGit) const;
+    std::string_view                      name(const size_t i) const;
+    size_t                                size() const { return count; }
+
+private:
+    void*           map     = nullptr;
+    size_t          mapSize = 0;
+    uint32_t        count   = 0;
+    const uint32_t* offsets = nullptr;
+    const char*     records = nullptr;
+
+    // the search index, see write_aur_metadata()
+    uint32_t        wordCount      = 0;
+    const uint32_t* wordOffsets    = nullptr;
+    const uint32_t* postingOffsets = nullptr;
+    const uint32_t* postings       = nullptr;
+    const char*     words          = nullptr;
+
+    TaurPkg_t              getPkg(const size_t i, const bool useGit) const;
+    std::string_view       word(const size_t i) const;
+    std::vector<uint32_t>  lookup(const std::string_view prefix) const;
+    std::vector<TaurPkg_t> searchText(const std::string_view query, const bool withDesc, const bool useGit) const;
+};
+
+const AurMetadata* load_aur_metadata();
+bool               write_aur_metadata(const path& json_path, const path& store_path);
+bool               update_aur_metadata(const bool force = false);
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef RPC_HPP
+#define RPC_HPP
+
+#include <rapidjson/memorystream.h>
+#include <rapidjson/reader.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "taur.hpp"
+#include "util.hpp"
+
+using std::filesystem::path;
+
+/** A rapidjson SAX handler that turns an AUR RPC response, or one of our RPC cache files (see writeRpcCache()),
+ * into TaurPkg_t directly from the text, without building a DOM first.
+ * It doesn't call into libalpm, so it can run in any thread, but TaurPkg_t::installed is left for the caller to fill.
+ */
+class RpcHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, RpcHandler>
+{
+public:
+    /** @param returnGit whether the packages should use a .git url
+     * @param cacheFile whether we're parsing a cache file, which wraps the response in "Data"
+     * @param keepRecords whether to keep the JSON of each package in records, e.g to cache them one by one
+     */
+    RpcHandler(const bool returnGit, const bool cacheFile, const bool keepRecords)
+        : returnGit(returnGit), keepRecords(keepRecords), rootDepth(cacheFile ? 2 : 1), writer(buffer)
+    {}
+
+    std::vector<TaurPkg_t>   pkgs;
+    std::vector<std::string> records;
+    std::int64_t             resultcount = -1;  // stays -1 if this wasn't an RPC response
+    std::int64_t             fetchedAt   = -1;  // only in cache files
+    std::string              type, error;
+
+    bool StartObject()
+    {
+        if (++depth == rootDepth + 2 && inResults)
+        {
+            inRecord       = true;
+            pkg            = TaurPkg_t();
+            pkg.maintainer = "\1";  // it's impossible that the maintainer name is a binary char
+            urlPath.clear();
+
+            if (keepRecords)
+            {
+                buffer.Clear();
+                writer.Reset(buffer);
+            }
+        }
+
+        return !recording() || writer.StartObject();
+    }
+
+    bool EndObject(const rapidjson::SizeType memberCount)
+    {
+        if (recording() && !writer.EndObject(memberCount))
+            return false;
+
+        if (inRecord && depth == rootDepth + 2)
+        {
+            inRecord = false;
+            endRecord();
+        }
+
+        depth--;
+        return true;
+    }
+
+    bool StartArray()
+    {
+        if (++depth == rootDepth + 1 && rootKey == "results")
+            inResults = true;
+
+        return !recording() || writer.StartArray();
+    }
+
+    bool EndArray(const rapidjson::SizeType elementCount)
+    {
+        if (recording() && !writer.EndArray(elementCount))
+            return false;
+
+        if (depth == rootDepth + 1)
+            inResults = false;
+
+        depth--;
+        return true;
+    }
+
+    bool Key(const char* str, const rapidjson::SizeType length, const bool)
+    {
+        if (recording() && !writer.Key(str, length))
+            return false;
+
+        if (depth == 1)
+            topKey.assign(str, length);
+        if (depth == rootDepth)
+            rootKey.assign(str, length);
+        else if (inRecord && depth == rootDepth + 2)
+            recordKey.assign(str, length);
+
+        return true;
+    }
+
+    bool String(const char* str, const rapidjson::SizeType length, const bool)
+    {
+        if (recording() && !writer.String(str, length))
+            return false;
+
+        const std::string_view value(str, length);
+
+        if (inRecord && depth == rootDepth + 2)
+        {
+            if (recordKey == "Name")
+                pkg.name = value;
+            else if (recordKey == "Version")
+                pkg.version = value;
+            else if (recordKey == "Description")
+                pkg.desc = value;
+            else if (recordKey == "Maintainer")
+                pkg.maintainer = intern_str(value);
+            else if (recordKey == "URLPath")
+                urlPath = value;
+        }
+        else if (inRecord && depth == rootDepth + 3)
+        {
+            if (recordKey == "Depends")
+                pkg.totaldepends.push_back(intern_str(value));
+            else if (recordKey == "MakeDepends")
+                makedepends.push_back(intern_str(value));
+            else if (recordKey == "License")
+                pkg.licenses.push_back(intern_str(value));
+        }
+        else if (depth == rootDepth && rootKey == "type")
+            type = value;
+        else if (depth == rootDepth && rootKey == "error")
+            error = value;
+
+        return true;
+    }
+
+    bool Int(const int i) { return (!recording() || writer.Int(i)) && Number(i); }
+    bool Uint(const unsigned u) { return (!recording() || writer.Uint(u)) && Number(u); }
+    bool Int64(const std::int64_t i) { return (!recording() || writer.Int64(i)) && Number(i); }
+    bool Uint64(const std::uint64_t u) { return (!recording() || writer.Uint64(u)) && Number(u); }
+    bool Double(const double d) { return (!recording() || writer.Double(d)) && Number(d); }
+    bool Null() { return !recording() || writer.Null(); }
+    bool Bool(const bool b) { return !recording() || writer.Bool(b); }
+
+private:
+    const bool returnGit;
+    const bool keepRecords;
+    // how deep the RPC response object is, the packages are 2 levels deeper (in the "results" array)
+    const int rootDepth;
+
+    int         depth     = 0;
+    bool        inResults = false;
+    bool        inRecord  = false;
+    std::string topKey, rootKey, recordKey;
+
+    TaurPkg_t                     pkg;
+    std::string                   urlPath;
+    std::vector<std::string_view> makedepends;  // until the end of the package, they go after depends
+
+    rapidjson::StringBuffer                    buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer;
+
+    bool recording() const
+    { return keepRecords && inRecord; }
+
+    template <typename T>
+    bool Number(const T value)
+    {
+        if (inRecord && depth == rootDepth + 2)
+        {
+            if (recordKey == "LastModified")
+                pkg.last_modified = value;
+            else if (recordKey == "OutOfDate")
+                pkg.outofdate = value;
+            else if (recordKey == "Popularity")
+                pkg.popularity = value;
+            else if (recordKey == "NumVotes")
+                pkg.votes = value;
+        }
+        else if (depth == rootDepth && rootKey == "resultcount")
+            resultcount = value;
+        else if (depth == 1 && rootDepth == 2 && topKey == "FetchedAt")
+            fetchedAt = value;
+
+        return true;
+    }
+
+    void endRecord()
+    {
+        // URLPath starts with a /
+        pkg.aur_url = returnGit ? AUR_URL_GIT(pkg.name) : AUR_URL + urlPath;
+
+        // yes, it will get depends and makedepends even if one doesn't have it
+        pkg.dependsCount = pkg.totaldepends.size();
+        pkg.totaldepends.insert(pkg.totaldepends.end(), makedepends.begin(), makedepends.end());
+        makedepends.clear();
+
+        if (keepRecords)
+            records.emplace_back(buffer.GetString(), buffer.GetSize());
+
+        pkgs.push_back(std::move(pkg));
+    }
+};
+
+/** Parse an AUR RPC response, or one of our RPC cache files.
+ * @param stream the JSON to parse, any rapidjson input stream
+ * @param handler where the packages and the other fields end up
+ * @return false if the JSON is broken, or isn't an RPC response
+ */
+template <typename Stream>
+bool parseRpc(Stream& stream, RpcHandler& handler)
+{
+    rapidjson::Reader reader;
+    return !reader.Parse(stream, handler).IsError() && handler.resultcount >= 0;
+}
+
+bool parseRpcString(const std::string_view json, RpcHandler& handler);
+
+path getRpcCachePath(const std::string_view name);
+bool readRpcCache(const path& file_path, RpcHandler& handler);
+bool isRpcCacheFresh(const RpcHandler& handler);
+void writeRpcCache(const path& file_path, const std::string_view data);
+
+#endif
@@ -4,14 +4,16 @@
 #include <alpm.h>
 #include <alpm_list.h>
 #include <fcntl.h>
-#include <rapidjson/document.h>
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include <ctime>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <span>
 
 #include "cpr/cpr.h"
 #include "util.hpp"
@@ -22,26 +24,54 @@ using std::filesystem::path;
 
 struct TaurPkg_t
 {
-    std::string              name;
-    std::string              version;
-    std::string              aur_url;
-    std::string              url;
-    std::string              desc;
-    std::string              arch;
-    std::string              maintainer;
-    time_t                   last_modified;
-    time_t                   outofdate;
-    float                    popularity = 1;  // normal
-    float                    votes      = 0;  // system packages have no votes
-    std::vector<std::string> licenses;
-    std::vector<std::string> makedepends;
-    std::vector<std::string> depends;
-    std::vector<std::string> totaldepends;
-    bool                     installed = false;
-    std::string              db_name   = "aur";
-
-    alpm_list_t* licenses_list;
-    alpm_list_t* depends_list;
+    std::string                   name;
+    std::string                   version;
+    std::string                   aur_url;
+    std::string                   url;
+    std::string                   desc;
+    std::string                   arch;
+    std::string_view              maintainer;  // interned, see intern_str()
+    time_t                        last_modified;
+    time_t                        outofdate;
+    float                         popularity = 1;  // normal
+    float                         votes      = 0;  // system packages have no votes
+    std::vector<std::string_view> licenses;        // interned
+    // depends followed by makedepends, interned. see depends() and makedepends()
+    std::vector<std::string_view> totaldepends;
+    size_t                        dependsCount = 0;
+    bool                          installed    = false;
+    std::string_view              db_name      = "aur";
+
+    std::span<const std::string_view> depends() const
+    { return std::span(totaldepends).first(dependsCount); }
+    std::span<const std::string_view> makedepends() const
+    { return std::span(totaldepends).subspan(dependsCount); }
+};
+
+// A package for TaurBackend::build_pkgs() to build.
+struct BuildJob_t
+{
+    TaurPkg_t pkg;
+    path      dir;                      // where its PKGBUILD is
+    bool      alreadyprepared = false;  // sources were already extracted and prepared
+};
+
+// What building a package produced, see TaurBackend::build_pkgs()
+struct BuildResult_t
+{
+    std::string              pkgname;    // the package that was asked for
+    std::vector<std::string> artifacts;  // every package file its PKGBUILD builds, see get_packagelist()
+
+    std::vector<std::string> pkgArtifacts() const;
+    bool                     built() const;
+};
+
+// An installed AUR package that can be upgraded, see TaurBackend::computeUpgradeCandidates()
+struct UpgradeCandidate_t
+{
+    TaurPkg_t local;   // the installed package, only its name and version are known
+    TaurPkg_t online;  // the package on the AUR
+    bool      devel;   // a -git package, it may have changed even if the AUR version didn't
 };
 
 class TaurBackend
@@ -51,25 +81,54 @@ public:
     TaurBackend(Config& cfg);
     // They are different because we found that fetching each AUR pkg is very time consuming, so we store the name and
     // look it up later.
-    std::vector<TaurPkg_t>   getPkgFromJson(const rapidjson::Document& doc, const bool useGit);
     std::vector<TaurPkg_t>   search_pac(const std::string_view query);
     std::vector<TaurPkg_t>   search(const std::string_view query, const bool useGit, const bool aurOnly,
                                     const bool checkExactMatch = true);
+    std::optional<std::vector<TaurPkg_t>> search_rpc(const std::string_view query, const std::string_view searchBy,
+                                                     const bool useGit);
     bool                     download_tar(const std::string_view url, const path& out_path);
     bool                     download_git(const std::string_view url, const path& out_path);
     bool                     download_pkg(const std::string_view url, const path out_path);
+    std::vector<bool> download_pkgs(std::vector<std::string> const& urls, std::vector<path> const& out_paths);
     std::optional<TaurPkg_t> fetch_pkg(const std::string_view pkg, const bool returnGit);
-    std::vector<TaurPkg_t>   fetch_pkgs(std::vector<std::string> const& pkgs, const bool returnGit);
+    std::vector<TaurPkg_t>   fetch_pkgs(std::vector<std::string> const& pkgs, const bool returnGit,
+                                        bool* failed = nullptr);
     bool                     remove_pkgs(const alpm_list_smart_pointer& pkgs);
     bool                     remove_pkg(alpm_pkg_t* pkgs, const bool ownTransaction = true);
-    bool handle_aur_depends(const TaurPkg_t& pkg, const path& out_path, std::vector<TaurPkg_t> const& localPkgs,
-                            const bool useGit);
-    bool build_pkg(const std::string_view pkg_name, const std::string_view extracted_path, const bool alreadyprepared);
+    std::vector<TaurPkg_t>   resolve_aur_depends(const std::vector<TaurPkg_t>& pkgs,
+                                                 std::vector<TaurPkg_t> const& localPkgs, const bool useGit);
+    bool handle_aur_depends(std::vector<BuildJob_t>& jobs, const path& out_path,
+                            std::vector<TaurPkg_t> const& localPkgs, const bool useGit);
+    bool build_pkg(const std::string_view pkg_name, const std::string_view extracted_path, BuildResult_t& result,
+                   const bool alreadyprepared, const bool sourcesVerified = false);
+    std::vector<std::string> build_pkgs(const std::vector<BuildJob_t>& jobs, std::vector<BuildResult_t>& toInstall);
+    std::vector<UpgradeCandidate_t> computeUpgradeCandidates(const std::vector<TaurPkg_t>& localPkgs,
+                                                             const bool useGit, bool* failed = nullptr);
     bool update_all_aur_pkgs(const path& cacheDir, const bool useGit);
     std::vector<TaurPkg_t> get_all_local_pkgs(const bool aurOnly);
+    cpr::Response          http_get(const std::string_view url);
+    cpr::Response          http_download(const std::string_view url, std::ofstream& out);
+
+private:
+    // sessions that aren't used by any request right now, they keep their connection to the AUR open.
+    std::mutex                                 sessionsMutex;
+    std::vector<std::unique_ptr<cpr::Session>> idleSessions;
+
+    std::unique_ptr<cpr::Session> get_session();
+    void                          put_session(std::unique_ptr<cpr::Session> session);
 };
 
-inline std::string              built_pkg, pkgs_to_install;
+bool                                  install_builds(const std::vector<BuildResult_t>& results);
+std::vector<size_t>                   sortIndices(const std::vector<std::vector<size_t>>& dependencies);
+std::vector<TaurPkg_t>                sortByDepends(std::vector<TaurPkg_t>&& pkgs);
+std::vector<UpgradeCandidate_t>       findUpgradeCandidates(const std::vector<TaurPkg_t>& localPkgs,
+                                                            std::vector<TaurPkg_t>&&      onlinePkgs);
+int                                   formatUpdates(const std::vector<UpgradeCandidate_t>& candidates,
+                                                    const bool failed, const bool json, std::string& output);
+std::optional<std::vector<TaurPkg_t>> readForeignPkgsCache(const std::string_view key);
+bool                                  writeForeignPkgsCache(const std::string_view        key,
+                                                            const std::vector<TaurPkg_t>& pkgs);
+
 inline std::vector<std::string> pkgs_failed_to_build;
 
 #endif
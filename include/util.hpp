@@ -1,12 +1,18 @@
 #ifndef UTIL_HPP
 #define UTIL_HPP
 
+#include <sys/resource.h>
+
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
@@ -36,6 +42,10 @@ class TaurBackend;
 #define AUR_URL_GIT(x) fmt::format("https://aur.archlinux.org/{}.git", x)
 #define AUR_URL_TAR(x) fmt::format("https://aur.archlinux.org/cgit/aur.git/snapshot/{}.tar.gz", x)
 
+// how many info requests can be in flight at once
+#define AUR_RPC_MAX_JOBS 4
+#define AUR_RPC_INFO_URL AUR_URL "/rpc/v5/info?"
+
 #define alpm_list_smart_pointer std::unique_ptr<alpm_list_t, decltype(&alpm_list_free)>
 #define make_list_smart_pointer(pointer) \
     (std::unique_ptr<alpm_list_t, decltype(&alpm_list_free)>(pointer, alpm_list_free))
@@ -89,24 +99,73 @@ enum log_level
     NONE  // display no prefix for this.
 };
 
+/** Sorted list of every AUR package name, memory-mapped from cacheDir/packages.aur.idx
+ * The file is an array of count+1 offsets followed by the names, so lookups never allocate.
+ */
+class AurList
+{
+public:
+    AurList() = default;
+    ~AurList();
+
+    // it owns its mapping, a copy would unmap it a second time
+    AurList(const AurList&)            = delete;
+    AurList& operator=(const AurList&) = delete;
+
+    bool             load(const path& index_path);
+    bool             contains(const std::string_view name) const;
+    std::string_view at(const size_t i) const;
+    size_t           size() const { return count; }
+
+private:
+    void*           map     = nullptr;
+    size_t          mapSize = 0;
+    uint32_t        count   = 0;
+    const uint32_t* offsets = nullptr;
+    const char*     names   = nullptr;
+};
+
+// Where a command runs and with what environment, so nothing of taur's own has to be changed for it
+struct ExecOptions_t
+{
+    path                     cwd;  // empty for taur's working directory
+    std::vector<std::string> env;  // "KEY=value", added to taur's environment or replacing what's in it
+};
+
+// What a command run by capture_exec() printed, and how it ended
+struct ExecResult_t
+{
+    std::string   out;
+    std::string   err;
+    int           exitCode = -1;     // -1 if it didn't exit by itself, e.g it was killed
+    bool          timedOut = false;  // it was killed for taking too long
+    struct rusage usage    = {};     // the CPU time and memory it used, see getrusage(2)
+
+    bool success() const
+    { return exitCode == 0; }
+};
+
 bool            hasEnding(const std::string_view fullString, const std::string_view ending);
 bool            hasStart(const std::string_view fullString, const std::string_view start);
 std::string     expandVar(std::string str);
 bool            is_numerical(const std::string_view s, const bool allowSpace = false);
-bool            taur_read_exec(std::vector<const char*> cmd, std::string& output, const bool exitOnFailure = true);
+bool            taur_read_exec(std::vector<const char*> cmd, std::string& output, const bool exitOnFailure = true,
+                               const std::chrono::milliseconds timeout = {}, const ExecOptions_t& options = {});
+ExecResult_t    capture_exec(std::vector<const char*> cmd, const std::chrono::milliseconds timeout = {},
+                             const ExecOptions_t& options = {});
 void            interruptHandler(int);
-bool            taur_exec(std::vector<std::string> cmd, const bool exitOnFailure = true);
+bool            taur_exec(std::vector<std::string> cmd, const bool exitOnFailure = true,
+                          const ExecOptions_t& options = {}, const path& logFile = {});
 void            sanitizeStr(std::string& str);
 bool            is_package_from_syncdb(const char* name, alpm_list_t* syncdbs);
+std::string     get_db_state(alpm_handle_t* handle, alpm_list_t* syncdbs);
 bool            commitTransactionAndRelease(const bool soft = false);
 void            printPkgInfo(const TaurPkg_t& pkg, const std::string_view db_name);
 void            printLocalFullPkgInfo(alpm_pkg_t* pkg);
-std::string     makepkg_list(const std::string_view pkg_name, const std::string_view path);
-void            getFileValue(u_short& iterIndex, const std::string& line, std::string& str, const size_t& amount);
 void            free_list_and_internals(alpm_list_t* list);
 fmt::text_style getColorFromDBName(const std::string_view db_name);
-std::vector<alpm_pkg_t*>      filterAURPkgs(std::vector<alpm_pkg_t*>& pkgs, alpm_list_t* syncdbs, const bool inverse);
-std::vector<std::string_view> filterAURPkgsNames(std::vector<std::string_view>& pkgs, alpm_list_t* syncdbs,
+std::vector<alpm_pkg_t*> filterAURPkgs(const std::vector<alpm_pkg_t*>& pkgs, alpm_list_t* syncdbs, const bool inverse);
+std::vector<std::string_view> filterAURPkgsNames(const std::vector<std::string_view>& pkgs, alpm_list_t* syncdbs,
                                                  const bool inverse);
 std::string                   shell_exec(const std::string_view cmd);
 std::vector<std::string>      split(const std::string_view text, const char delim);
@@ -117,16 +176,27 @@ std::string                   getHomeCacheDir();
 std::string                   getHomeConfigDir();
 std::string                   getConfigDir();
 std::string                   getCacheDir();
-bool                          makepkg_exec(std::vector<std::string> const& args, const bool exitOnFailure = true);
+bool                          makepkg_exec(std::vector<std::string> const& args, const bool exitOnFailure = true,
+                                           const path& cwd = {}, const path& logFile = {});
 bool pacman_exec(const std::string_view op, std::vector<std::string> const& args, const bool exitOnFailure = true,
-                 const bool root = true);
+                 const bool root = true, std::vector<std::string> const& flags = {});
 bool util_db_search(alpm_db_t* db, alpm_list_t* needles, alpm_list_t** ret);
 
 std::optional<std::vector<TaurPkg_t>> askUserForPkg(const std::vector<TaurPkg_t>& pkgs, TaurBackend& backend,
                                                     const bool useGit);
 std::string_view                      binarySearch(const std::vector<std::string>& arr, const std::string_view target);
-std::vector<std::string>              load_aur_list();
+const AurList&                        load_aur_list();
+bool                                  write_aur_index(const path& list_path, const path& index_path);
+std::string_view                      getDependName(const std::string_view depend);
+std::string_view                      intern_str(const std::string_view str);
+std::vector<std::pair<std::string, size_t>> make_info_urls(std::vector<std::string> const& pkgs,
+                                                           const size_t                    maxLength);
+std::pair<size_t, size_t> info_url_range(std::vector<std::pair<std::string, size_t>> const& urls, const size_t i);
 bool                                  update_aur_cache(const bool recursiveCall = false);
+bool download_if_modified(const std::string_view url, const path& file_path, bool& changed, const bool inflate = true);
+void* map_file(const path& file_path, const size_t minSize, size_t& size);
+std::string sha256_hex(const std::string_view data);
+std::string sha256_file(const path& file_path);
 
 template <typename T>
 struct is_fmt_convertible
@@ -147,6 +217,39 @@ constexpr bool is_fmt_convertible_v = is_fmt_convertible<T>::value;
 
 constexpr std::size_t operator""_len(const char*, std::size_t ln) noexcept { return ln; }
 
+/** Call fn(i) for every i in [0, count), running at most `jobs` of them at the same time.
+ * Returns once every call has finished.
+ * Note: libalpm isn't thread safe, so fn shouldn't call into it.
+ * To have each call write its own result, use a std::vector<char> rather than a std::vector<bool>,
+ * whose elements share bytes, so writing one from two threads is a data race.
+ * @param count how many times fn will be called
+ * @param jobs the maximum number of threads to use, 1 or less runs everything on the calling thread
+ * @param fn the function to call, takes the index as a size_t
+ */
+template <typename Fn>
+void run_parallel(const size_t count, const size_t jobs, Fn&& fn)
+{
+    if (jobs <= 1 || count <= 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+            fn(i);
+        return;
+    }
+
+    std::atomic<size_t>      next = 0;
+    std::vector<std::thread> workers;
+    workers.reserve(std::min(jobs, count));
+
+    for (size_t i = 0; i < std::min(jobs, count); ++i)
+        workers.emplace_back([&]() {
+            for (size_t j = next++; j < count; j = next++)
+                fn(j);
+        });
+
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
 // clang-format off
 template <typename... Args>
 void _log_println(log_level log, const fmt::text_style ts, fmt::runtime_format_string<> fmt, Args&&... args)
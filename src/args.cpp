@@ -72,6 +72,12 @@ int parsearg_op(const int opt, const int dryrun)
         case 'r':
                 if(dryrun) break;
                 op.show_recipe = 1; break;
+        case OP_CHECK_UPDATES:
+                if(dryrun) break;
+                op.check_updates = 1; break;
+        case OP_JSON:
+                if(dryrun) break;
+                op.json = 1; break;
         default:
                 return 1;
     }
@@ -0,0 +1,160 @@
+// The build cache, so packages built from the exact same recipe are only built once.
+#include "buildcache.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "config.hpp"
+#include "makepkg.hpp"
+#include "util.hpp"
+
+// changed whenever what goes into the key changes, so older entries never get used
+inline constexpr std::string_view BUILD_CACHE_VERSION = "taur-build-cache-1";
+
+/** Hash everything a package is built from: its PKGBUILD and .SRCINFO, its local sources, and makepkg's configuration.
+ * Remote sources are pinned by their checksums, which are in the .SRCINFO.
+ * @param pkg_name the name of the package
+ * @param pkg_dir the folder of the package
+ * @return the key of the package in the build cache (a hex SHA-256), or empty if it can't be cached,
+ *         e.g VCS packages, which build something different each time their upstream changes
+ */
+std::string build_cache_key(const std::string_view pkg_name, const path& pkg_dir)
+{
+    if (hasEnding(pkg_name, "-git") || hasEnding(pkg_name, "-svn") || hasEnding(pkg_name, "-hg") ||
+        hasEnding(pkg_name, "-bzr") || hasEnding(pkg_name, "-fossil"))
+        return {};
+
+    // every AUR package has a .SRCINFO, it's the only way we know what its local sources are
+    const std::optional<Srcinfo_t>& srcinfo = parse_srcinfo_file(pkg_dir / ".SRCINFO");
+    if (!srcinfo || has_vcs_sources(*srcinfo))
+        return {};
+
+    // the hash of each file, so moving bytes from one file to the next changes the key
+    std::string hashes(BUILD_CACHE_VERSION);
+
+    const auto& addFile = [&](const std::string_view name, const path& file_path) {
+        const std::string& hash = sha256_file(file_path);
+        hashes += fmt::format("\n{} {}", hash, name);
+        return !hash.empty();
+    };
+
+    if (!addFile("PKGBUILD", pkg_dir / "PKGBUILD") || !addFile(".SRCINFO", pkg_dir / ".SRCINFO"))
+        return {};
+
+    std::vector<std::string_view> localSources;
+    for (const auto& [key, sources] : srcinfo->values)
+    {
+        if (key != "source" && !hasStart(key, "source_"))
+            continue;
+
+        for (std::string_view source : sources)
+        {
+            if (const size_t rename = source.find("::"); rename != std::string_view::npos)
+                source.remove_prefix(rename + "::"_len);
+
+            if (source.find("://") == std::string_view::npos)
+                localSources.push_back(source);
+        }
+    }
+
+    // the order of the values isn't the same everywhere, the key has to be
+    std::sort(localSources.begin(), localSources.end());
+
+    for (const std::string_view source : localSources)
+    {
+        if (!addFile(source, pkg_dir / source))
+        {
+            log_println(DEBUG, "Can't cache {}, its source {} couldn't be read", pkg_name, source);
+            return {};
+        }
+    }
+
+    // CFLAGS, PKGEXT and such change what gets built too
+    hashes += fmt::format("\n{} makepkg.conf", get_makepkg_conf().fingerprint());
+
+    return sha256_hex(hashes);
+}
+
+/** Copy the packages we built before with the same key where makepkg would have put them.
+ * @param key what build_cache_key() returned
+ * @param pkg_dir the folder makepkg puts the packages in, PKGDEST or the folder of the package
+ * @return true if they were found and copied
+ */
+bool restore_cached_build(const std::string_view key, const path& pkg_dir)
+{
+    const path& entry = config->buildCacheDir / key;
+
+    std::error_code ec;
+    bool            restored = false;
+
+    for (const auto& file : std::filesystem::directory_iterator(entry, ec))
+    {
+        if (!file.is_regular_file(ec))
+            continue;
+
+        // copy it somewhere else first, so a package is never half there
+        const path& dest_path = pkg_dir / file.path().filename();
+        const path& tmp_path  = fmt::format("{}.{}", dest_path.string(), getpid());
+
+        std::filesystem::copy_file(file.path(), tmp_path, std::filesystem::copy_options::overwrite_existing, ec);
+        if (!ec)
+            std::filesystem::rename(tmp_path, dest_path, ec);
+
+        if (ec)
+        {
+            log_println(DEBUG, "Failed to copy {} from the build cache: {}", file.path().string(), ec.message());
+            std::filesystem::remove(tmp_path, ec);
+            return false;
+        }
+
+        restored = true;
+    }
+
+    return restored;
+}
+
+/** Keep the packages we just built in the build cache.
+ * @param key what build_cache_key() returned
+ * @param artifacts every package file the PKGBUILD builds, the ones that weren't built (e.g debug packages) are skipped
+ * @return true if they're in the build cache now
+ */
+bool store_cached_build(const std::string_view key, const std::vector<std::string>& artifacts)
+{
+    const path& entry = config->buildCacheDir / key;
+
+    std::error_code ec;
+    if (std::filesystem::exists(entry, ec))
+        return true;
+
+    // fill it somewhere else first, so other taur processes, maybe on other machines, never see it half filled.
+    const path& tmp_path = fmt::format("{}.{}.{}", entry.string(), gethostid(), getpid());
+
+    std::filesystem::create_directories(tmp_path, ec);
+
+    bool stored = false;
+    for (size_t i = 0; i < artifacts.size() && !ec; ++i)
+    {
+        const path& artifact = artifacts[i];
+        if (!std::filesystem::exists(artifact, ec))
+            continue;
+
+        std::filesystem::copy_file(artifact, tmp_path / artifact.filename(), ec);
+        stored = true;
+    }
+
+    if (!ec && !stored)
+        ec = std::make_error_code(std::errc::no_such_file_or_directory);
+    if (!ec)
+        std::filesystem::rename(tmp_path, entry, ec);
+
+    if (ec)
+    {
+        // someone else may have stored the same build in the meantime, theirs is just as good
+        std::filesystem::remove_all(tmp_path, ec);
+        return std::filesystem::exists(entry, ec);
+    }
+
+    log_println(DEBUG, "Stored {} in the build cache as {}", artifacts, key);
+    return true;
+}
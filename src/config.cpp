@@ -1,6 +1,7 @@
 #define TOML_HEADER_ONLY 0
 #include "config.hpp"
 
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
 
@@ -77,17 +78,27 @@ void Config::initVars()
 {
     this->cacheDir =
         path(this->getConfigValue<std::string>("general.cacheDir", std::string(getHomeCacheDir()) + "/TabAUR"));
-    this->pmConfig      = this->getConfigValue<std::string>("pacman.ConfigFile", "/etc/pacman.conf");
-    this->makepkgConf   = this->getConfigValue<std::string>("pacman.MakepkgConf", "/etc/makepkg.conf");
-    this->makepkgBin    = this->getConfigValue<std::string>("bins.makepkg", "makepkg");
-    this->git           = this->getConfigValue<std::string>("bins.git", "git");
-    this->sudo          = this->getConfigValue<std::string>("general.sudo", "sudo");
-    this->useGit        = this->getConfigValue<bool>("general.useGit", true);
-    this->aurOnly       = this->getConfigValue<bool>("general.aurOnly", false);
-    this->debug         = this->getConfigValue<bool>("general.debug", true);
-    this->colors        = this->getConfigValue<bool>("general.colors", true);
-    this->secretRecipe  = this->getConfigValue<bool>("secret.recipe", false);
-    fmt::disable_colors = (!this->colors);
+    this->buildCacheDir =
+        path(this->getConfigValue<std::string>("general.buildCacheDir", (this->cacheDir / ".build-cache").string()));
+    this->pmConfig        = this->getConfigValue<std::string>("pacman.ConfigFile", "/etc/pacman.conf");
+    this->makepkgConf     = this->getConfigValue<std::string>("pacman.MakepkgConf", "/etc/makepkg.conf");
+    this->makepkgBin      = this->getConfigValue<std::string>("bins.makepkg", "makepkg");
+    this->git             = this->getConfigValue<std::string>("bins.git", "git");
+    this->sudo            = this->getConfigValue<std::string>("general.sudo", "sudo");
+    this->useGit          = this->getConfigValue<bool>("general.useGit", true);
+    this->aurOnly         = this->getConfigValue<bool>("general.aurOnly", false);
+    this->debug           = this->getConfigValue<bool>("general.debug", true);
+    this->colors          = this->getConfigValue<bool>("general.colors", true);
+    this->secretRecipe    = this->getConfigValue<bool>("secret.recipe", false);
+    this->rpcCacheTTL     = this->getConfigValue<std::int64_t>("general.rpcCacheTTL", 300);
+    this->aurListMaxAge   = this->getConfigValue<std::int64_t>("general.aurListMaxAge", 24);
+    this->rpcMaxUrlLength = this->getConfigValue<std::int64_t>("general.rpcMaxUrlLength", 4000);
+    this->buildJobs       = std::max<std::int64_t>(this->getConfigValue<std::int64_t>("general.buildJobs", 1), 1);
+    this->fetchJobs       = std::max<std::int64_t>(this->getConfigValue<std::int64_t>("general.fetchJobs", 4), 1);
+    this->localMetadata   = this->getConfigValue<bool>("general.localMetadata", false);
+    this->metadataMaxAge  = this->getConfigValue<std::int64_t>("general.metadataMaxAge", 24);
+    this->buildCache      = this->getConfigValue<bool>("general.buildCache", false);
+    fmt::disable_colors   = (!this->colors);
 
     sanitizeStr(this->sudo);
     sanitizeStr(this->makepkgBin);
@@ -135,6 +146,7 @@ void Config::loadConfigFile(const std::string_view filename)
         die(_("Failed to get an alpm handle! Error: {}"), alpm_strerror(err));
 
     this->loadPacmanConfigFile(this->getConfigValue<std::string>("pacman.ConfigFile", "/etc/pacman.conf"));
+    this->dbStateAtLoad = get_db_state(this->handle, this->repos);
 }
 
 /** parse the theme file (aka "theme.toml")
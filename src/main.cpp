@@ -14,6 +14,7 @@
 #include <limits.h>
 
 #include "args.hpp"
+#include "metadata.hpp"
 #include "taur.hpp"
 #include "util.hpp"
 
@@ -32,6 +33,7 @@ void usage(const int op)
     taur {-h --help}
     taur {-V --version}
     taur {-t, --test-colors}
+    taur {--check-updates} [--json]
     taur {-D --database} <options> <package(s)>
     taur {-F --files}    [options] [file(s)]
     taur {-Q --query}    [options] [package(s)]
@@ -49,7 +51,7 @@ void usage(const int op)
             fmt::println("options:{}", R"(
     -s, --search <regex> search remote repositories for matching strings
     -u, --sysupgrade     upgrade installed packages (-uu enables downgrades)
-    -y, --refresh        download fresh package databases from the server
+    -y, --refresh        download fresh package databases (and local AUR metadata) from the server
             )"sv);
         }
         else if (op == OP_QUERY)
@@ -146,14 +148,19 @@ void execPacman(int argc, char* argv[])
 
 int installPkg(alpm_list_t* pkgNames)
 {
+    // so that "taur -Sy" alone can keep the local AUR metadata up to date, e.g from a timer
+    const bool refreshMetadata   = op.op_s_sync && config->localMetadata;
+    const bool metadataRefreshed = refreshMetadata && update_aur_metadata(true);
+    if (refreshMetadata && !metadataRefreshed)
+        log_println(ERROR, _("Failed to refresh the local AUR metadata"));
+
     if (!pkgNames && !op.op_s_upgrade)
-        return false;
+        return metadataRefreshed;
 
     const bool  useGit   = config->useGit;
     const path& cacheDir = config->cacheDir;
 
     bool returnStatus = true;
-    bool stat;
 
     std::vector<std::string>      pacmanPkgs;  // list of pacman packages to install, to avoid spamming pacman.
     std::vector<std::string_view> pkgNamesVec;
@@ -197,12 +204,12 @@ int installPkg(alpm_list_t* pkgNames)
         log_println(ERROR, _("Failed to get information about {}"), (config->cacheDir / "packages.aur").string());
 
     // I swear there was a comment here..
-    const std::vector<std::string_view>& AURPkgs =
-        filterAURPkgsNames(pkgNamesVec, alpm_get_syncdbs(config->handle), true);
+    alpm_list_t*                         syncdbs = alpm_get_syncdbs(config->handle);
+    const std::vector<std::string_view>& AURPkgs = filterAURPkgsNames(pkgNamesVec, syncdbs, true);
 
     for (const std::string_view pkg : pkgNamesVec)
     {
-        if (std::find(AURPkgs.begin(), AURPkgs.end(), pkg) == AURPkgs.end())
+        if (is_package_from_syncdb(pkg.data(), syncdbs))
             pacmanPkgs.push_back(pkg.data());
     }
 
@@ -212,17 +219,25 @@ int installPkg(alpm_list_t* pkgNames)
     if (!config->noconfirm && !AURPkgs.empty())
         pkgsToReview = askUserForList<std::string_view>(AURPkgs, PROMPT_LIST_REVIEWS);
 
+    std::vector<std::string> urls;
+    std::vector<path>        pkgDirs;
+    urls.reserve(AURPkgs.size());
+    pkgDirs.reserve(AURPkgs.size());
+
     for (const std::string_view pkg_name : AURPkgs)
     {
-        const path& pkgDir = cacheDir / pkg_name;
+        urls.push_back(useGit ? AUR_URL_GIT(pkg_name) : AUR_URL_TAR(pkg_name));
+        pkgDirs.push_back(cacheDir / pkg_name);
+    }
+
+    const std::vector<bool>& downloaded = backend->download_pkgs(urls, pkgDirs);
 
-        stat = useGit ? backend->download_git(AUR_URL_GIT(pkg_name), pkgDir)
-                      : backend->download_tar(AUR_URL_TAR(pkg_name), pkgDir);
-        if (!stat)
+    for (size_t i = 0; i < AURPkgs.size(); ++i)
+    {
+        if (!downloaded[i])
         {
-            log_println(ERROR, _("Failed to download {}"), pkg_name);
+            log_println(ERROR, _("Failed to download {}"), AURPkgs[i]);
             returnStatus = false;
-            continue;
         }
     }
 
@@ -283,12 +298,27 @@ int installPkg(alpm_list_t* pkgNames)
     {
         log_println(INFO, _("Upgrading AUR packages!"));
         backend->update_all_aur_pkgs(cacheDir, useGit);
-
-        pkgs_to_install = "";  // Reset the list.
     }
 
+    // look up every target at once, only the ones that aren't an exact AUR package name need a search
+    std::vector<std::string> AURPkgsNames(AURPkgs.begin(), AURPkgs.end());
+    std::vector<TaurPkg_t>   infoPkgs = backend->fetch_pkgs(AURPkgsNames, useGit);
+
+    std::vector<BuildJob_t> jobs;
+
     for (size_t i = 0; i < AURPkgs.size(); i++)
     {
+        const auto& info = std::find_if(infoPkgs.begin(), infoPkgs.end(),
+                                        [&](const TaurPkg_t& pkg) { return pkg.name == AURPkgs[i]; });
+
+        if (info != infoPkgs.end())
+        {
+            jobs.push_back({ std::move(*info), cacheDir / AURPkgs[i] });
+            continue;
+        }
+
+        log_println(DEBUG, "{} isn't an AUR package name, searching for it", AURPkgs[i]);
+
         const std::vector<TaurPkg_t>& pkgs = backend->search(AURPkgs[i], useGit, config->aurOnly, true);
 
         const std::optional<std::vector<TaurPkg_t>>& oSelectedPkgs = askUserForPkg(pkgs, *backend, useGit);
@@ -299,41 +329,30 @@ int installPkg(alpm_list_t* pkgNames)
             continue;
         }
 
-        const std::vector<TaurPkg_t>& selectedPkgs = oSelectedPkgs.value();
-
-        for (const TaurPkg_t& pkg : selectedPkgs)
-        {
-            path pkgDir = cacheDir / pkg.name;
-
-            stat = backend->handle_aur_depends(pkg, cacheDir, backend->get_all_local_pkgs(true), useGit);
-
-            if (!stat)
-            {
-                log_println(ERROR, _("Installing AUR dependencies for your package has failed."));
-                returnStatus = false;
-                continue;
-            }
+        for (const TaurPkg_t& pkg : oSelectedPkgs.value())
+            jobs.push_back({ pkg, cacheDir / pkg.name });
+    }
 
-            stat = backend->build_pkg(pkg.name, pkgDir.string(), false);
+    if (!jobs.empty() && !backend->handle_aur_depends(jobs, cacheDir, backend->get_all_local_pkgs(true), useGit))
+    {
+        log_println(ERROR, _("Installing AUR dependencies for your package has failed."));
+        returnStatus = false;
+    }
 
-            if (!stat)
-            {
-                log_println(ERROR, _("Building '{}' has failed."), pkg.name);
-                returnStatus = false;
-                pkgs_failed_to_build.push_back(pkg.name);
-                log_println(DEBUG, "pkgs_failed_to_build = {}", pkgs_failed_to_build);
-                continue;
-            }
+    std::vector<BuildResult_t>      toInstall;
+    const std::vector<std::string>& failed = backend->build_pkgs(jobs, toInstall);
 
-            pkgs_to_install += built_pkg + ' ';
-        }
+    if (!failed.empty())
+    {
+        returnStatus = false;
+        pkgs_failed_to_build.insert(pkgs_failed_to_build.end(), failed.begin(), failed.end());
+        log_println(DEBUG, "pkgs_failed_to_build = {}", pkgs_failed_to_build);
     }
 
-    if (!pkgs_to_install.empty())
+    if (!toInstall.empty())
     {
         log_println(DEBUG, _("Installing {}"), fmt::join(pkgNamesVec, " "));
-        pkgs_to_install.pop_back();
-        if (!pacman_exec("-U", split(pkgs_to_install, ' '), false))
+        if (!install_builds(toInstall))
         {
             log_println(ERROR, _("Failed to install {}"), fmt::join(pkgNamesVec, " "));
             returnStatus = false;
@@ -546,6 +565,30 @@ bool queryPkgs(alpm_list_t* pkgNames)
     return true;
 }
 
+/** Print which installed AUR packages are outdated, with batched info requests, without asking anything or writing
+ * anything to the disk. One "name\tinstalled version\tAUR version" line per package, or a JSON array with --json.
+ * @return 0 if there are updates, 2 if there are none, 1 if the AUR couldn't be reached
+ */
+int checkUpdates()
+{
+    config->readOnly = true;
+
+    const std::vector<TaurPkg_t>& localPkgs = backend->get_all_local_pkgs(true);
+
+    bool                                   failed = false;
+    const std::vector<UpgradeCandidate_t>& candidates =
+        backend->computeUpgradeCandidates(localPkgs, config->useGit, &failed);
+
+    std::string output;
+    const int   ret = formatUpdates(candidates, failed, op.json, output);
+
+    if (failed)
+        log_println(ERROR, _("Couldn't check for updates, failed to reach the AUR"));
+
+    fmt::print("{}", output);
+    return ret;
+}
+
 bool upgradePkgs(alpm_list_t* pkgNames)
 {
     if (!pkgNames)
@@ -669,6 +712,8 @@ int parseargs(int argc, char* argv[])
         {"help",       no_argument,       0, 'h'},
         {"test-colors",no_argument,       0, 't'},
         {"recipe",     no_argument,       0, 'r'},
+        {"check-updates", no_argument,    0, OP_CHECK_UPDATES},
+        {"json",       no_argument,       0, OP_JSON},
 
         {"refresh",    no_argument,       0, OP_REFRESH},
         {"sysupgrade", no_argument,       0, OP_SYSUPGRADE},
@@ -823,6 +868,10 @@ int main(int argc, char* argv[])
     // the code you're likely interested in
     backend = std::make_unique<TaurBackend>(*config);
 
+    // it doesn't build or write anything, so monitoring can run it as root
+    if (op.check_updates)
+        return checkUpdates();
+
     if (op.requires_root && geteuid() != 0)
     {
         log_println(ERROR, _("You need to be root to do this."));
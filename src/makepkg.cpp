@@ -0,0 +1,573 @@
+// Knowing what makepkg builds, and how, without running it each time: .SRCINFO files and makepkg.conf.
+#include "makepkg.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "config.hpp"
+#include "util.hpp"
+
+static const std::vector<std::string> EMPTY_LIST;
+
+// makepkg only sources the PKGBUILD to print what's in it, when it takes longer the PKGBUILD is stuck on something
+inline constexpr std::chrono::seconds MAKEPKG_QUERY_TIMEOUT(60);
+
+// the variables of makepkg.conf that makepkg lets the environment override
+inline constexpr std::array<std::string_view, 10> MAKEPKG_ENV_OVERRIDES = {
+    "PKGDEST", "SRCDEST", "SRCPKGDEST", "LOGDEST", "BUILDDIR", "PKGEXT", "SRCEXT", "GPGKEY", "PACKAGER", "CARCH",
+};
+
+/** Get the first value of a key of the pkgbase, e.g pkgver.
+ * @return the value, or empty if there's none
+ */
+std::string_view Srcinfo_t::get(const std::string& key) const
+{
+    const auto& it = this->values.find(key);
+    return it == this->values.end() || it->second.empty() ? std::string_view() : it->second.front();
+}
+
+/** Get every value of a key of the pkgbase, e.g depends.
+ * @param key the key
+ * @param arch if not empty, the values of key_arch are added too, e.g depends_x86_64
+ * @return the values
+ */
+std::vector<std::string> Srcinfo_t::getList(const std::string& key, const std::string_view arch) const
+{
+    std::vector<std::string> out;
+
+    if (const auto& it = this->values.find(key); it != this->values.end())
+        out = it->second;
+
+    if (!arch.empty())
+        if (const auto& it = this->values.find(fmt::format("{}_{}", key, arch)); it != this->values.end())
+            out.insert(out.end(), it->second.begin(), it->second.end());
+
+    return out;
+}
+
+/** Get every value of a key of a package, which are the pkgbase's unless the package overrides them.
+ * @param pkgname the package, one of pkgnames
+ * @param key the key, e.g arch
+ * @return the values
+ */
+const std::vector<std::string>& Srcinfo_t::getPkgList(const std::string& pkgname, const std::string& key) const
+{
+    if (const auto& pkg = this->overrides.find(pkgname); pkg != this->overrides.end())
+        if (const auto& it = pkg->second.find(key); it != pkg->second.end())
+            return it->second;
+
+    const auto& it = this->values.find(key);
+    return it == this->values.end() ? EMPTY_LIST : it->second;
+}
+
+/** Get the full version of the packages, as pacman shows it.
+ * @return [epoch:]pkgver-pkgrel
+ */
+std::string Srcinfo_t::version() const
+{
+    std::string version(this->get("pkgver"));
+
+    if (const std::string_view pkgrel = this->get("pkgrel"); !pkgrel.empty())
+        version = fmt::format("{}-{}", version, pkgrel);
+
+    if (const std::string_view epoch = this->get("epoch"); !epoch.empty() && epoch != "0")
+        version = fmt::format("{}:{}", epoch, version);
+
+    return version;
+}
+
+/** Parse a .SRCINFO, or what makepkg --printsrcinfo printed.
+ * It starts with a pkgbase section, followed by a section for each package, every line of a section is
+ * "key = value", and a package section only has the keys it overrides.
+ * @param text the whole .SRCINFO
+ * @return the parsed .SRCINFO, or nothing if it has no pkgbase or no pkgname
+ */
+std::optional<Srcinfo_t> parse_srcinfo(const std::string_view text)
+{
+    Srcinfo_t      srcinfo;
+    SrcinfoValues* section = nullptr;
+
+    size_t lineStart = 0;
+    while (lineStart < text.length())
+    {
+        size_t lineEnd = text.find('\n', lineStart);
+        if (lineEnd == std::string_view::npos)
+            lineEnd = text.length();
+
+        std::string_view line = text.substr(lineStart, lineEnd - lineStart);
+        lineStart             = lineEnd + 1;
+
+        line.remove_prefix(std::min(line.find_first_not_of(" \t"), line.length()));
+        line.remove_suffix(line.length() - std::min(line.find_last_not_of(" \t\r") + 1, line.length()));
+
+        const size_t equal = line.find('=');
+        if (line.empty() || line[0] == '#' || equal == std::string_view::npos)
+            continue;
+
+        std::string_view key   = line.substr(0, equal);
+        std::string_view value = line.substr(equal + 1);
+        key.remove_suffix(key.length() - std::min(key.find_last_not_of(' ') + 1, key.length()));
+        value.remove_prefix(std::min(value.find_first_not_of(' '), value.length()));
+
+        if (key == "pkgbase")
+        {
+            srcinfo.pkgbase = value;
+            section         = &srcinfo.values;
+        }
+        else if (key == "pkgname")
+        {
+            srcinfo.pkgnames.emplace_back(value);
+            section = &srcinfo.overrides[srcinfo.pkgnames.back()];
+        }
+        else if (section)
+        {
+            // an overridden array that's empty in the package is written as "key = "
+            std::vector<std::string>& list = (*section)[std::string(key)];
+            if (!value.empty())
+                list.emplace_back(value);
+        }
+    }
+
+    if (srcinfo.pkgbase.empty() || srcinfo.pkgnames.empty())
+        return {};
+
+    return srcinfo;
+}
+
+std::optional<Srcinfo_t> parse_srcinfo_file(const path& file_path)
+{
+    std::ifstream file(file_path);
+    if (!file.is_open())
+        return {};
+
+    std::stringstream text;
+    text << file.rdbuf();
+    return parse_srcinfo(text.str());
+}
+
+/** Check whether a source is fetched from a VCS, such as git+https://...
+ * VCS sources are fetched at their latest commit, and pkgver() rewrites the PKGBUILD with the version it got.
+ * @param source a source, maybe renamed ("name::url")
+ */
+bool is_vcs_source(std::string_view source)
+{
+    if (const size_t rename = source.find("::"); rename != std::string_view::npos)
+        source.remove_prefix(rename + "::"_len);
+
+    const size_t protocolEnd = source.find("://");
+    if (protocolEnd == std::string_view::npos)
+        return false;
+
+    // e.g git+https://
+    const std::string_view protocol = source.substr(0, std::min(source.find('+'), protocolEnd));
+    return protocol == "git" || protocol == "svn" || protocol == "hg" || protocol == "bzr" || protocol == "fossil";
+}
+
+bool has_vcs_sources(const Srcinfo_t& srcinfo)
+{
+    for (const auto& [key, values] : srcinfo.values)
+        if (key == "source" || hasStart(key, "source_"))
+            if (std::any_of(values.begin(), values.end(), is_vcs_source))
+                return true;
+
+    return false;
+}
+
+/** Keep what makepkg printed in the cache, unless we're told not to write anything.
+ * It's written somewhere else first, so other taur processes or threads never read a half written file.
+ */
+static void writeCacheFile(const path& cache_path, const std::string_view output)
+{
+    if (config->readOnly)
+        return;
+
+    std::error_code ec;
+    std::filesystem::create_directories(cache_path.parent_path(), ec);
+
+    const path&   tmp_path = fmt::format("{}.{}", cache_path.string(), gettid());
+    std::ofstream file(tmp_path, std::ios::trunc);
+    file << output;
+    file.close();
+
+    if (file)
+        std::filesystem::rename(tmp_path, cache_path, ec);
+    else
+        std::filesystem::remove(tmp_path, ec);
+}
+
+/** Get what a package's PKGBUILD builds.
+ * Its .SRCINFO is used when we can trust it, else makepkg --printsrcinfo is run and its output is cached in
+ * cacheDir/.srcinfo under the hash of the PKGBUILD, so it's only run again once the PKGBUILD changes.
+ * That's when there's no .SRCINFO, and for VCS packages, whose pkgver() rewrites the PKGBUILD but not the .SRCINFO.
+ * @param pkg_dir the folder of the package
+ * @return the parsed .SRCINFO, or nothing if neither it nor makepkg could tell
+ */
+std::optional<Srcinfo_t> get_srcinfo(const path& pkg_dir)
+{
+    std::optional<Srcinfo_t> srcinfo = parse_srcinfo_file(pkg_dir / ".SRCINFO");
+    if (srcinfo && !has_vcs_sources(*srcinfo))
+        return srcinfo;
+
+    const std::string& hash = sha256_file(pkg_dir / "PKGBUILD");
+    if (hash.empty())
+        return srcinfo;
+
+    const path& cache_path = config->cacheDir / ".srcinfo" / hash;
+    if (std::optional<Srcinfo_t> cached = parse_srcinfo_file(cache_path))
+        return cached;
+
+    const std::string& pkgbuild = (pkg_dir / "PKGBUILD").string();
+    std::string        output;
+    if (!taur_read_exec({ config->makepkgBin.c_str(), "--printsrcinfo", "-p", pkgbuild.c_str() }, output, false,
+                        MAKEPKG_QUERY_TIMEOUT, { pkg_dir }))
+        return srcinfo;
+
+    std::optional<Srcinfo_t> printed = parse_srcinfo(output);
+    if (!printed)
+        return srcinfo;
+
+    writeCacheFile(cache_path, output);
+    return printed;
+}
+
+/** Get every package file a PKGBUILD builds, split and debug packages included, from makepkg --packagelist.
+ * Its output is cached in cacheDir/.packagelist under the hash of the PKGBUILD and of makepkg's configuration,
+ * which decides the extension, the architecture, and whether there are debug packages.
+ * @param pkg_dir the folder of the package
+ * @return the paths the package files are built at, or nothing if makepkg failed
+ */
+std::optional<std::vector<std::string>> get_packagelist(const path& pkg_dir)
+{
+    const std::string& hash = sha256_file(pkg_dir / "PKGBUILD");
+    if (hash.empty())
+        return {};
+
+    const MakepkgConf& makepkgConf = get_makepkg_conf();
+    const path&        cache_path  = config->cacheDir / ".packagelist" / sha256_hex(hash + makepkgConf.fingerprint());
+
+    std::string output;
+    bool        printed = false;
+    if (std::ifstream file(cache_path); file.is_open())
+    {
+        std::stringstream text;
+        text << file.rdbuf();
+        output = text.str();
+    }
+    else
+    {
+        const std::string& pkgbuild = (pkg_dir / "PKGBUILD").string();
+        if (!taur_read_exec({ config->makepkgBin.c_str(), "--packagelist", "-p", pkgbuild.c_str() }, output, false,
+                            MAKEPKG_QUERY_TIMEOUT, { pkg_dir }))
+            return {};
+
+        printed = true;
+    }
+
+    // makepkg lists them in PKGDEST, which is the folder it's run from when it isn't set
+    const std::string_view pkgdest = makepkgConf.get("PKGDEST");
+    const path&            dir     = pkgdest.empty() ? pkg_dir : path(pkgdest);
+
+    std::vector<std::string> files;
+    for (const std::string& line : split(output, '\n'))
+        if (!line.empty())
+            files.push_back((dir / path(line).filename()).string());
+
+    if (files.empty())
+        return {};
+
+    // only once we know it lists something, else it would be used until the PKGBUILD changes
+    if (printed)
+        writeCacheFile(cache_path, output);
+
+    return files;
+}
+
+/** Get the name of the package in a package file, e.g foo-docs in /tmp/foo-docs-1:1.2.3-2-any.pkg.tar.zst.
+ * pkgver, pkgrel and arch can't have a '-', so it's whatever is before the last three.
+ * @return the name, or empty if it isn't a package file
+ */
+std::string_view package_file_pkgname(std::string_view file)
+{
+    file.remove_prefix(file.rfind('/') + 1);
+
+    size_t end = file.length();
+    for (int i = 0; i < 3; ++i)
+    {
+        if (end == 0 || (end = file.rfind('-', end - 1)) == std::string_view::npos)
+            return {};
+    }
+
+    return file.substr(0, end);
+}
+
+static bool isNameChar(const char c)
+{ return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; }
+
+/** Expand the variable at text[i], which is a '$', the way bash would, e.g $CFLAGS or ${CFLAGS}.
+ * Variables are looked up in what was loaded so far, then in the environment.
+ * Anything else, such as $(nproc), is kept as it is.
+ * @param i moved past the variable
+ */
+std::string MakepkgConf::readVariable(const std::string_view text, size_t& i) const
+{
+    const bool   braced    = text.substr(i + 1, 1) == "{";
+    const size_t nameBegin = i + (braced ? 2 : 1);
+
+    size_t nameEnd = nameBegin;
+    while (nameEnd < text.length() && isNameChar(text[nameEnd]))
+        ++nameEnd;
+
+    if (nameEnd == nameBegin)
+    {
+        ++i;
+        return "$";
+    }
+
+    const std::string name(text.substr(nameBegin, nameEnd - nameBegin));
+    // skip whatever else is in the braces, e.g ${CFLAGS:-}
+    i = braced ? std::min(text.find('}', nameEnd), text.length() - 1) + 1 : nameEnd;
+
+    if (const auto& it = this->values.find(name); it != this->values.end())
+        return it->second.empty() ? std::string() : it->second.front();
+
+    const char* env = getenv(name.c_str());
+    return env ? env : "";
+}
+
+/** Read a bash word at text[i], handling its quotes, escapes and variables.
+ * @param i moved past the word
+ */
+std::string MakepkgConf::readWord(const std::string_view text, size_t& i) const
+{
+    std::string word;
+
+    while (i < text.length())
+    {
+        const char c = text[i];
+
+        if (c == ' ' || c == '\t' || c == '\n' || c == ';' || c == ')')
+            break;
+
+        if (c == '\'')
+        {
+            const size_t end = std::min(text.find('\'', i + 1), text.length());
+            word += text.substr(i + 1, end - i - 1);
+            i = end + 1;
+        }
+        else if (c == '"')
+        {
+            for (++i; i < text.length() && text[i] != '"';)
+            {
+                // inside double quotes, a backslash only escapes these
+                if (text[i] == '\\' && i + 1 < text.length() && std::strchr("\"\\$`", text[i + 1]))
+                {
+                    word += text[i + 1];
+                    i += 2;
+                }
+                else if (text[i] == '$')
+                    word += this->readVariable(text, i);
+                else
+                    word += text[i++];
+            }
+            ++i;
+        }
+        else if (c == '\\' && i + 1 < text.length())
+        {
+            word += text[i + 1];
+            i += 2;
+        }
+        else if (c == '$')
+            word += this->readVariable(text, i);
+        else
+            word += text[i++];
+    }
+
+    return word;
+}
+
+/** Read the assignments of a makepkg.conf, on top of what was loaded before.
+ * Any other command is skipped, and so are the assignments in if, case and loop bodies,
+ * since we can't tell whether bash would run them.
+ * @param text the whole file
+ */
+void MakepkgConf::parse(const std::string_view text)
+{
+    const auto& skipLine    = [&text](size_t& i) { i = std::min(text.find('\n', i), text.length()); };
+    const auto& skipCommand = [&text](size_t& i) { i = std::min(text.find_first_of(";\n", i), text.length()); };
+
+    // how deep in if/case/for/while/until blocks we are
+    int depth = 0;
+
+    size_t i = 0;
+    while ((i = text.find_first_not_of(" \t\n;", i)) != std::string_view::npos)
+    {
+        if (text[i] == '#')
+        {
+            skipLine(i);
+            continue;
+        }
+
+        size_t nameEnd = i;
+        while (nameEnd < text.length() && isNameChar(text[nameEnd]))
+            ++nameEnd;
+
+        const std::string_view name   = text.substr(i, nameEnd - i);
+        const bool             append = text.substr(nameEnd, 2) == "+=";
+
+        if (name == "export" || name == "then" || name == "else" || name == "do")
+        {
+            i = nameEnd;
+            continue;
+        }
+
+        if (name == "fi" || name == "esac" || name == "done")
+        {
+            depth = std::max(depth - 1, 0);
+            i     = nameEnd;
+            continue;
+        }
+
+        if (name == "if" || name == "case" || name == "for" || name == "while" || name == "until")
+            ++depth;
+
+        if (name.empty() || (!append && text.substr(nameEnd, 1) != "="))
+        {
+            skipCommand(i);
+            continue;
+        }
+
+        i = nameEnd + (append ? 2 : 1);
+
+        std::vector<std::string> words;
+        const bool               array = i < text.length() && text[i] == '(';
+
+        if (array)
+        {
+            for (++i; (i = text.find_first_not_of(" \t\n", i)) != std::string_view::npos;)
+            {
+                if (text[i] == ')')
+                {
+                    ++i;
+                    break;
+                }
+
+                if (text[i] == '#')
+                {
+                    skipLine(i);
+                    continue;
+                }
+
+                const size_t wordBegin = i;
+                words.push_back(this->readWord(text, i));
+                if (i == wordBegin)  // a stray ';'
+                    ++i;
+            }
+        }
+        else
+            words.push_back(this->readWord(text, i));  // "KEY=" is an empty word
+
+        if (depth > 0)
+            continue;
+
+        std::vector<std::string>& list = this->values[std::string(name)];
+        if (!append)
+            list = std::move(words);
+        else if (array || list.empty())
+            list.insert(list.end(), std::make_move_iterator(words.begin()), std::make_move_iterator(words.end()));
+        else
+            list.front() += words.front();
+    }
+}
+
+bool MakepkgConf::loadFile(const path& file_path, std::string& hashes)
+{
+    std::ifstream file(file_path);
+    if (!file.is_open())
+        return false;
+
+    std::stringstream text;
+    text << file.rdbuf();
+
+    hashes += fmt::format("\n{} {}", sha256_hex(text.str()), file_path.string());
+    this->parse(text.str());
+    return true;
+}
+
+/** Load makepkg's configuration, as makepkg --config conf_path would.
+ * @param conf_path the main makepkg.conf
+ * @return false if it couldn't be read, the others are optional
+ */
+bool MakepkgConf::load(const path& conf_path)
+{
+    std::string hashes;
+    if (!this->loadFile(conf_path, hashes))
+        return false;
+
+    // in the same order as bash expands makepkg.conf.d/*.conf
+    std::vector<path> dropins;
+    std::error_code   ec;
+    for (const auto& entry : std::filesystem::directory_iterator(path(conf_path) += ".d", ec))
+        if (entry.path().extension() == ".conf")
+            dropins.push_back(entry.path());
+
+    std::sort(dropins.begin(), dropins.end());
+    for (const path& dropin : dropins)
+        this->loadFile(dropin, hashes);
+
+    if (!this->loadFile(path(getHomeConfigDir()) / "pacman" / "makepkg.conf", hashes))
+        if (const char* home = getenv("HOME"))
+            this->loadFile(path(home) / ".makepkg.conf", hashes);
+
+    // empty ones don't override anything, makepkg uses ${_PKGDEST:-$PKGDEST}
+    for (const std::string_view key : MAKEPKG_ENV_OVERRIDES)
+    {
+        const char* value = getenv(key.data());
+        if (value && value[0] != '\0')
+        {
+            this->values[std::string(key)] = { value };
+            hashes += fmt::format("\n{}={}", key, value);
+        }
+    }
+
+    this->fingerprintHash = sha256_hex(hashes);
+    return true;
+}
+
+/** Get the first value of a variable, e.g CARCH.
+ * @return the value, or empty if it isn't set
+ */
+std::string_view MakepkgConf::get(const std::string& key) const
+{
+    const auto& it = this->values.find(key);
+    return it == this->values.end() || it->second.empty() ? std::string_view() : it->second.front();
+}
+
+/** Get every value of an array, e.g BUILDENV.
+ * @return the values, or an empty list if it isn't set
+ */
+const std::vector<std::string>& MakepkgConf::getList(const std::string& key) const
+{
+    const auto& it = this->values.find(key);
+    return it == this->values.end() ? EMPTY_LIST : it->second;
+}
+
+/** Get makepkg's configuration, the one makepkg gets with --config config->makepkgConf.
+ * It's loaded the first time this is called, and shared by every caller and thread after that.
+ */
+const MakepkgConf& get_makepkg_conf()
+{
+    static const MakepkgConf makepkgConf = [] {
+        MakepkgConf conf;
+        if (!conf.load(config->makepkgConf))
+            log_println(WARN, _("Failed to read {}"), config->makepkgConf);
+        return conf;
+    }();
+
+    return makepkgConf;
+}
@@ -0,0 +1,852 @@
+// The local copy of the AUR's metadata, for searching and getting package info without asking the AUR.
+#include "metadata.hpp"
+
+#include <rapidjson/reader.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <unordered_map>
+
+#include "config.hpp"
+#include "util.hpp"
+
+// "TAURMET" followed by the format version
+inline constexpr std::string_view AUR_METADATA_MAGIC = "TAURMET2";
+
+/* The store is laid out as:
+ * - the magic, how many packages there are (uint32_t), and count+1 offsets (uint32_t) of the packages
+ * - the packages, sorted by name
+ * - padding up to a multiple of 4 bytes, then the search index: how many words there are (uint32_t),
+ *   count+1 offsets of the words, count+1 offsets of their postings (uint32_t), the postings,
+ *   which are the indices of the packages each word is in, and the words, sorted
+ *
+ * Each package in the store is laid out as:
+ * - LastModified and OutOfDate (int64_t), then Popularity and NumVotes (float)
+ * - its strings, in StringField order, each one is its length (uint32_t) followed by the string
+ * - its lists, in ListField order, each one is how many strings it has (uint32_t) followed by the strings
+ */
+inline constexpr size_t RECORD_HEADER_SIZE = sizeof(std::int64_t) * 2 + sizeof(float) * 2;
+
+enum StringField
+{
+    FIELD_NAME,
+    FIELD_VERSION,
+    FIELD_DESCRIPTION,
+    FIELD_URL,
+    FIELD_URLPATH,
+    FIELD_MAINTAINER,
+    STRING_FIELDS
+};
+
+enum ListField
+{
+    FIELD_DEPENDS,
+    FIELD_MAKEDEPENDS,
+    FIELD_OPTDEPENDS,
+    FIELD_CHECKDEPENDS,
+    FIELD_LICENSE,
+    LIST_FIELDS
+};
+
+// the keys of each field in packages-meta-ext-v1.json
+inline constexpr std::array<std::string_view, STRING_FIELDS> STRING_KEYS = {
+    "Name", "Version", "Description", "URL", "URLPath", "Maintainer"
+};
+inline constexpr std::array<std::string_view, LIST_FIELDS> LIST_KEYS = {
+    "Depends", "MakeDepends", "OptDepends", "CheckDepends", "License"
+};
+
+template <typename T>
+static void append(std::string& out, const T value)
+{ out.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+
+static void appendStr(std::string& out, const std::string_view str)
+{
+    append<uint32_t>(out, str.length());
+    out += str;
+}
+
+/** Call fn with every word of text, in lowercase. Words are made of letters and digits,
+ * e.g "python-requests: HTTP for Humans" has the words python, requests, http, for and humans.
+ */
+template <typename Fn>
+static void forEachWord(const std::string_view text, Fn&& fn)
+{
+    std::string word;
+    for (const unsigned char c : text)
+    {
+        if (std::isalnum(c))
+            word += std::tolower(c);
+        else if (!word.empty())
+        {
+            fn(std::move(word));
+            word.clear();
+        }
+    }
+
+    if (!word.empty())
+        fn(std::move(word));
+}
+
+// Reads the fields of a package in the store one after another.
+class RecordReader
+{
+public:
+    RecordReader(const char* pos) : pos(pos) {}
+
+    template <typename T>
+    T read()
+    {
+        T value;
+        std::memcpy(&value, pos, sizeof(value));
+        pos += sizeof(value);
+        return value;
+    }
+
+    std::string_view readStr()
+    {
+        const uint32_t         length = read<uint32_t>();
+        const std::string_view str(pos, length);
+        pos += length;
+        return str;
+    }
+
+    void skipStr()
+    { pos += read<uint32_t>(); }
+
+    // skip the header and the strings before field
+    static RecordReader seekString(const char* record, const size_t field)
+    {
+        RecordReader reader(record + RECORD_HEADER_SIZE);
+        for (size_t i = 0; i < field; ++i)
+            reader.skipStr();
+
+        return reader;
+    }
+
+    // skip the header, the strings and the lists before field, the next read<uint32_t>() is the size of the list.
+    static RecordReader seekList(const char* record, const size_t field)
+    {
+        RecordReader reader = seekString(record, STRING_FIELDS);
+        for (size_t i = 0; i < field; ++i)
+            for (uint32_t count = reader.read<uint32_t>(); count > 0; --count)
+                reader.skipStr();
+
+        return reader;
+    }
+
+private:
+    const char* pos;
+};
+
+/** A rapidjson input stream that reads a file through zlib, which reads uncompressed files as they are too.
+ * Works like rapidjson::FileReadStream, the end of the file reads as '\0'.
+ */
+class GzReadStream
+{
+public:
+    typedef char Ch;
+
+    GzReadStream(gzFile file) : file(file)
+    { read(); }
+
+    Ch Peek() const
+    { return *current; }
+
+    Ch Take()
+    {
+        const Ch c = *current;
+        read();
+        return c;
+    }
+
+    size_t Tell() const
+    { return count + (current - buffer.data()); }
+
+    // we only read
+    Ch*    PutBegin() { return nullptr; }
+    void   Put(Ch) {}
+    void   Flush() {}
+    size_t PutEnd(Ch*) { return 0; }
+
+private:
+    gzFile                    file;
+    std::array<Ch, 64 * 1024> buffer;
+    Ch*                       current   = buffer.data();
+    Ch*                       last      = nullptr;
+    size_t                    readCount = 0;
+    size_t                    count     = 0;
+    bool                      eof       = false;
+
+    void read()
+    {
+        if (current < last)
+            ++current;
+        else if (!eof)
+        {
+            count += readCount;
+            const int ret = gzread(file, buffer.data(), buffer.size());
+            readCount     = ret > 0 ? ret : 0;
+            last          = buffer.data() + readCount - 1;
+            current       = buffer.data();
+
+            if (readCount < buffer.size())
+            {
+                buffer[readCount] = '\0';
+                ++last;
+                eof = true;
+            }
+        }
+    }
+};
+
+/** A rapidjson SAX handler that turns packages-meta-ext-v1.json, an array with every AUR package,
+ * into the packages of the store, in the order they come.
+ */
+class MetadataHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, MetadataHandler>
+{
+public:
+    std::string         records;  // every package, one after another
+    std::vector<size_t> starts;   // where each package starts in records
+    bool                isArray = false;
+
+    bool StartObject()
+    {
+        if (++depth == 2 && isArray)
+        {
+            for (std::string& str : strings)
+                str.clear();
+            for (std::string& list : lists)
+                list.clear();
+
+            listSizes.fill(0);
+            strings[FIELD_MAINTAINER] = "\1";  // orphan, it's the same in the RPC handler
+            lastModified = outOfDate = 0;
+            popularity = votes = 0;
+        }
+
+        return true;
+    }
+
+    bool EndObject(const rapidjson::SizeType)
+    {
+        if (depth-- == 2 && isArray)
+            writeRecord();
+
+        return true;
+    }
+
+    bool StartArray()
+    {
+        if (++depth == 1)
+            isArray = true;
+
+        return true;
+    }
+
+    bool EndArray(const rapidjson::SizeType)
+    {
+        depth--;
+        return true;
+    }
+
+    bool Key(const char* str, const rapidjson::SizeType length, const bool)
+    {
+        if (depth == 2)
+            key.assign(str, length);
+
+        return true;
+    }
+
+    bool String(const char* str, const rapidjson::SizeType length, const bool)
+    {
+        if (!isArray)
+            return true;
+
+        if (depth == 2)
+        {
+            const auto& it = std::find(STRING_KEYS.begin(), STRING_KEYS.end(), key);
+            if (it != STRING_KEYS.end())
+                strings[it - STRING_KEYS.begin()].assign(str, length);
+        }
+        else if (depth == 3)
+        {
+            const auto& it = std::find(LIST_KEYS.begin(), LIST_KEYS.end(), key);
+            if (it != LIST_KEYS.end())
+            {
+                appendStr(lists[it - LIST_KEYS.begin()], std::string_view(str, length));
+                listSizes[it - LIST_KEYS.begin()]++;
+            }
+        }
+
+        return true;
+    }
+
+    bool Int(const int i) { return Number(i); }
+    bool Uint(const unsigned u) { return Number(u); }
+    bool Int64(const std::int64_t i) { return Number(i); }
+    bool Uint64(const std::uint64_t u) { return Number(u); }
+    bool Double(const double d) { return Number(d); }
+
+private:
+    int         depth = 0;
+    std::string key;
+
+    std::array<std::string, STRING_FIELDS> strings;
+    std::array<std::string, LIST_FIELDS>   lists;  // already in the format of the store, without their size
+    std::array<uint32_t, LIST_FIELDS>      listSizes;
+    std::int64_t                           lastModified = 0, outOfDate = 0;
+    float                                  popularity = 0, votes = 0;
+
+    template <typename T>
+    bool Number(const T value)
+    {
+        if (depth != 2 || !isArray)
+            return true;
+
+        if (key == "LastModified")
+            lastModified = value;
+        else if (key == "OutOfDate")
+            outOfDate = value;
+        else if (key == "Popularity")
+            popularity = value;
+        else if (key == "NumVotes")
+            votes = value;
+
+        return true;
+    }
+
+    void writeRecord()
+    {
+        starts.push_back(records.size());
+
+        append(records, lastModified);
+        append(records, outOfDate);
+        append(records, popularity);
+        append(records, votes);
+
+        for (const std::string& str : strings)
+            appendStr(records, str);
+
+        for (size_t i = 0; i < LIST_FIELDS; ++i)
+        {
+            append(records, listSizes[i]);
+            records += lists[i];
+        }
+    }
+};
+
+/** Convert packages-meta-ext-v1.json.gz into the store AurMetadata maps.
+ * @param json_path the metadata, compressed or not
+ * @param store_path where to write the store
+ * @return true on success
+ */
+bool write_aur_metadata(const path& json_path, const path& store_path)
+{
+    gzFile file = gzopen(json_path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    MetadataHandler   handler;
+    GzReadStream      stream(file);
+    rapidjson::Reader reader;
+
+    const bool parsed = !reader.Parse(stream, handler).IsError() && handler.isArray;
+    gzclose(file);
+
+    if (!parsed)
+    {
+        log_println(DEBUG, "{} isn't valid, stopped at offset {}", json_path.string(), stream.Tell());
+        return false;
+    }
+
+    const std::string& records = handler.records;
+    if (records.size() > UINT32_MAX)
+        return false;
+
+    std::vector<size_t>& starts = handler.starts;
+    const uint32_t       count  = starts.size();
+    starts.push_back(records.size());
+
+    const auto& getName = [&](const size_t i) {
+        return RecordReader::seekString(records.data() + starts[i], FIELD_NAME).readStr();
+    };
+
+    std::vector<size_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](const size_t a, const size_t b) { return getName(a) < getName(b); });
+
+    std::vector<uint32_t> offsets;
+    offsets.reserve(count + 1);
+
+    uint32_t offset = 0;
+    for (const size_t i : order)
+    {
+        offsets.push_back(offset);
+        offset += starts[i + 1] - starts[i];
+    }
+    offsets.push_back(offset);
+
+    // the search index: every word of the names and descriptions, with the packages it's in
+    std::unordered_map<std::string, std::vector<uint32_t>> words;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const auto& addWord = [&](std::string&& word) {
+            std::vector<uint32_t>& postings = words[std::move(word)];
+            if (postings.empty() || postings.back() != i)
+                postings.push_back(i);
+        };
+
+        RecordReader reader = RecordReader::seekString(records.data() + starts[order[i]], FIELD_NAME);
+        forEachWord(reader.readStr(), addWord);
+        reader.skipStr();  // version
+        forEachWord(reader.readStr(), addWord);
+    }
+
+    std::vector<std::pair<std::string, std::vector<uint32_t>>> index(std::make_move_iterator(words.begin()),
+                                                                     std::make_move_iterator(words.end()));
+    std::sort(index.begin(), index.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    const uint32_t        wordCount = index.size();
+    std::vector<uint32_t> wordOffsets{ 0 }, postingOffsets{ 0 };
+    wordOffsets.reserve(wordCount + 1);
+    postingOffsets.reserve(wordCount + 1);
+
+    for (const auto& [word, postings] : index)
+    {
+        wordOffsets.push_back(wordOffsets.back() + word.length());
+        postingOffsets.push_back(postingOffsets.back() + postings.size());
+    }
+
+    const path&   tmp_path = fmt::format("{}.{}", store_path.string(), getpid());
+    std::ofstream outfile(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!outfile.is_open())
+        return false;
+
+    outfile.write(AUR_METADATA_MAGIC.data(), AUR_METADATA_MAGIC.length());
+    outfile.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    outfile.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+    for (const size_t i : order)
+        outfile.write(records.data() + starts[i], starts[i + 1] - starts[i]);
+
+    // the index is read as uint32_t, so it has to start at a multiple of 4
+    const size_t recordsEnd = AUR_METADATA_MAGIC.length() + sizeof(uint32_t) * (count + 2) + offset;
+    outfile.write("\0\0\0", (4 - recordsEnd % 4) % 4);
+
+    outfile.write(reinterpret_cast<const char*>(&wordCount), sizeof(wordCount));
+    outfile.write(reinterpret_cast<const char*>(wordOffsets.data()), wordOffsets.size() * sizeof(uint32_t));
+    outfile.write(reinterpret_cast<const char*>(postingOffsets.data()), postingOffsets.size() * sizeof(uint32_t));
+    for (const auto& [word, postings] : index)
+        outfile.write(reinterpret_cast<const char*>(postings.data()), postings.size() * sizeof(uint32_t));
+    for (const auto& [word, postings] : index)
+        outfile.write(word.data(), word.length());
+
+    outfile.close();
+    if (!outfile)
+        return false;
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, store_path, ec);
+
+    return !ec;
+}
+
+AurMetadata::~AurMetadata()
+{
+    if (this->map)
+        munmap(this->map, this->mapSize);
+}
+
+/** Map a store made by write_aur_metadata()
+ * @param store_path the store
+ * @return true on success, false if the file is missing or doesn't look like a store
+ */
+bool AurMetadata::load(const path& store_path)
+{
+    size_t size;
+    void*  map = map_file(store_path, AUR_METADATA_MAGIC.length() + sizeof(uint32_t), size);
+    if (!map)
+        return false;
+
+    const char* data = static_cast<const char*>(map);
+
+    uint32_t count;
+    std::memcpy(&count, data + AUR_METADATA_MAGIC.length(), sizeof(count));
+
+    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data + AUR_METADATA_MAGIC.length() + sizeof(count));
+    const size_t    recordsStart =
+        AUR_METADATA_MAGIC.length() + sizeof(uint32_t) * (static_cast<size_t>(count) + 2);
+
+    // count is checked first, it's whatever the file says and anything computed from it could be way off
+    if (std::string_view(data, AUR_METADATA_MAGIC.length()) != AUR_METADATA_MAGIC || count > size / sizeof(uint32_t) ||
+        recordsStart > size || offsets[count] > size - recordsStart)
+    {
+        munmap(map, size);
+        return false;
+    }
+
+    const size_t recordsEnd = recordsStart + offsets[count];
+    const size_t indexStart = recordsEnd + (4 - recordsEnd % 4) % 4;
+
+    uint32_t wordCount = 0;
+    if (indexStart + sizeof(wordCount) <= size)
+        std::memcpy(&wordCount, data + indexStart, sizeof(wordCount));
+
+    const uint32_t* wordOffsets    = reinterpret_cast<const uint32_t*>(data + indexStart + sizeof(wordCount));
+    const uint32_t* postingOffsets = wordOffsets + wordCount + 1;
+    const size_t    postingsStart  = indexStart + sizeof(uint32_t) * (static_cast<size_t>(wordCount) * 2 + 3);
+
+    if (indexStart + sizeof(wordCount) > size || wordCount > size / sizeof(uint32_t) || postingsStart > size ||
+        postingOffsets[wordCount] > (size - postingsStart) / sizeof(uint32_t) ||
+        wordOffsets[wordCount] > size - postingsStart - postingOffsets[wordCount] * sizeof(uint32_t))
+    {
+        munmap(map, size);
+        return false;
+    }
+
+    if (this->map)
+        munmap(this->map, this->mapSize);
+
+    this->map     = map;
+    this->mapSize = size;
+    this->count   = count;
+    this->offsets = offsets;
+    this->records = data + recordsStart;
+
+    this->wordCount      = wordCount;
+    this->wordOffsets    = wordOffsets;
+    this->postingOffsets = postingOffsets;
+    this->postings       = reinterpret_cast<const uint32_t*>(data + postingsStart);
+    this->words          = data + postingsStart + postingOffsets[wordCount] * sizeof(uint32_t);
+
+    return true;
+}
+
+std::string_view AurMetadata::name(const size_t i) const
+{ return RecordReader::seekString(this->records + this->offsets[i], FIELD_NAME).readStr(); }
+
+TaurPkg_t AurMetadata::getPkg(const size_t i, const bool useGit) const
+{
+    RecordReader reader(this->records + this->offsets[i]);
+    TaurPkg_t    pkg;
+
+    pkg.last_modified = reader.read<std::int64_t>();
+    pkg.outofdate     = reader.read<std::int64_t>();
+    pkg.popularity    = reader.read<float>();
+    pkg.votes         = reader.read<float>();
+
+    // same order as StringField
+    pkg.name    = reader.readStr();
+    pkg.version = reader.readStr();
+    pkg.desc    = reader.readStr();
+    pkg.url     = reader.readStr();
+
+    const std::string_view urlPath = reader.readStr();
+    pkg.maintainer                 = intern_str(reader.readStr());
+
+    // same order as ListField
+    for (uint32_t count = reader.read<uint32_t>(); count > 0; --count)
+        pkg.totaldepends.push_back(intern_str(reader.readStr()));
+
+    pkg.dependsCount = pkg.totaldepends.size();
+
+    for (uint32_t count = reader.read<uint32_t>(); count > 0; --count)
+        pkg.totaldepends.push_back(intern_str(reader.readStr()));
+
+    for (size_t list = FIELD_OPTDEPENDS; list < FIELD_LICENSE; ++list)
+        for (uint32_t count = reader.read<uint32_t>(); count > 0; --count)
+            reader.skipStr();
+
+    for (uint32_t count = reader.read<uint32_t>(); count > 0; --count)
+        pkg.licenses.push_back(intern_str(reader.readStr()));
+
+    // URLPath starts with a /
+    pkg.aur_url = useGit ? AUR_URL_GIT(pkg.name) : fmt::format(AUR_URL "{}", urlPath);
+
+    return pkg;
+}
+
+/** Get a package, like TaurBackend::fetch_pkg().
+ * @param name the name of the package
+ * @param useGit whether the package should use a .git url
+ * @return the package, or nothing if there's no AUR package with that name
+ */
+std::optional<TaurPkg_t> AurMetadata::find(const std::string_view name, const bool useGit) const
+{
+    size_t left = 0, right = this->count;
+
+    while (left < right)
+    {
+        const size_t mid = left + (right - left) / 2;
+        const int    cmp = this->name(mid).compare(name);
+
+        if (cmp == 0)
+            return this->getPkg(mid, useGit);
+        else if (cmp < 0)
+            left = mid + 1;
+        else
+            right = mid;
+    }
+
+    return {};
+}
+
+std::string_view AurMetadata::word(const size_t i) const
+{ return std::string_view(this->words + this->wordOffsets[i], this->wordOffsets[i + 1] - this->wordOffsets[i]); }
+
+/** Look up a word in the search index.
+ * @param prefix the start of the word, in lowercase
+ * @return the packages that have a word starting with prefix, sorted
+ */
+std::vector<uint32_t> AurMetadata::lookup(const std::string_view prefix) const
+{
+    // the words are sorted, so the ones starting with prefix come one after another, from the first one >= prefix
+    size_t left = 0, right = this->wordCount;
+    while (left < right)
+    {
+        const size_t mid = left + (right - left) / 2;
+        if (this->word(mid) < prefix)
+            left = mid + 1;
+        else
+            right = mid;
+    }
+
+    std::vector<uint32_t> out;
+    size_t                matched = 0;
+
+    for (size_t i = left; i < this->wordCount && hasStart(this->word(i), prefix); ++i, ++matched)
+        out.insert(out.end(), this->postings + this->postingOffsets[i], this->postings + this->postingOffsets[i + 1]);
+
+    if (matched > 1)
+    {
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+
+    return out;
+}
+
+// lowerNeedle has to be lowercase already
+static bool containsNoCase(const std::string_view str, const std::string_view lowerNeedle)
+{
+    return std::search(str.begin(), str.end(), lowerNeedle.begin(), lowerNeedle.end(), [](const char a, const char b) {
+               return std::tolower(static_cast<unsigned char>(a)) == b;
+           }) != str.end();
+}
+
+/** Search the names, and maybe the descriptions, with the search index.
+ * Every term (separated by spaces) of the query has to be in the package, and each word of a term has to be the start
+ * of a word of the package, e.g "python req" finds python-requests, but "ython" doesn't.
+ * @param query what to search for
+ * @param withDesc whether to search the descriptions too, and not only the names
+ * @param useGit whether the packages should use a .git url
+ * @return the packages that matched, the most popular first
+ */
+std::vector<TaurPkg_t> AurMetadata::searchText(const std::string_view query, const bool withDesc,
+                                               const bool useGit) const
+{
+    std::string lowerQuery(query);
+    std::transform(lowerQuery.begin(), lowerQuery.end(), lowerQuery.begin(),
+                   [](const unsigned char c) { return std::tolower(c); });
+
+    std::vector<std::string> terms = split(lowerQuery, ' ');
+    terms.erase(std::remove(terms.begin(), terms.end(), ""), terms.end());
+    if (terms.empty())
+        return {};
+
+    // intersect what each word finds, starting with the packages of the first one. nothing means every package,
+    // that's only the case if there are no words at all, e.g "c++" has one, but "++" has none.
+    std::optional<std::vector<uint32_t>> candidates;
+    for (const std::string& term : terms)
+    {
+        forEachWord(term, [&](std::string&& word) {
+            std::vector<uint32_t> found = this->lookup(word);
+
+            if (candidates)
+            {
+                const auto& end = std::set_intersection(candidates->begin(), candidates->end(), found.begin(),
+                                                        found.end(), candidates->begin());
+                candidates->erase(end, candidates->end());
+            }
+            else
+                candidates = std::move(found);
+        });
+    }
+
+    std::vector<TaurPkg_t> out;
+
+    const auto& check = [&](const size_t i) {
+        // the index only knows about words, check that the terms themselves are there, e.g "c++" and not just "c"
+        RecordReader           reader = RecordReader::seekString(this->records + this->offsets[i], FIELD_NAME);
+        const std::string_view name   = reader.readStr();
+        reader.skipStr();  // version
+        const std::string_view desc = withDesc ? reader.readStr() : std::string_view();
+
+        for (const std::string& term : terms)
+            if (!containsNoCase(name, term) && !containsNoCase(desc, term))
+                return;
+
+        out.push_back(this->getPkg(i, useGit));
+    };
+
+    if (candidates)
+        std::for_each(candidates->begin(), candidates->end(), check);
+    else
+        for (size_t i = 0; i < this->count; ++i)
+            check(i);
+
+    std::sort(out.begin(), out.end(), [](const TaurPkg_t& a, const TaurPkg_t& b) {
+        return a.popularity != b.popularity ? a.popularity > b.popularity : a.votes > b.votes;
+    });
+
+    return out;
+}
+
+/** Search the packages the way the AUR RPC does.
+ * @param query what to search for, words of the name and/or description, or the name of a maintainer or dependency
+ * @param searchBy the field to search, as in the RPC's "by" argument
+ * @param useGit whether the packages should use a .git url
+ * @return the packages that matched, or nothing if we can't search by searchBy locally
+ */
+std::optional<std::vector<TaurPkg_t>> AurMetadata::search(const std::string_view query,
+                                                          const std::string_view searchBy, const bool useGit) const
+{
+    if (searchBy == "name" || searchBy == "name-desc")
+        return this->searchText(query, searchBy == "name-desc", useGit);
+
+    const bool byMaintainer = searchBy == "maintainer";
+
+    size_t list = LIST_FIELDS;
+    if (searchBy == "depends")
+        list = FIELD_DEPENDS;
+    else if (searchBy == "makedepends")
+        list = FIELD_MAKEDEPENDS;
+    else if (searchBy == "optdepends")
+        list = FIELD_OPTDEPENDS;
+    else if (searchBy == "checkdepends")
+        list = FIELD_CHECKDEPENDS;
+
+    if (!byMaintainer && list == LIST_FIELDS)
+        return {};
+
+    std::vector<TaurPkg_t> out;
+
+    for (size_t i = 0; i < this->count; ++i)
+    {
+        const char* record = this->records + this->offsets[i];
+        bool        match  = false;
+
+        if (byMaintainer)
+            match = RecordReader::seekString(record, FIELD_MAINTAINER).readStr() == query;
+        else
+        {
+            RecordReader reader = RecordReader::seekList(record, list);
+            // optdepends also have a description, after a ':'
+            for (uint32_t count = reader.read<uint32_t>(); count > 0 && !match; --count)
+            {
+                const std::string_view depend = reader.readStr();
+                match                         = getDependName(depend.substr(0, depend.find(':'))) == query;
+            }
+        }
+
+        if (match)
+            out.push_back(this->getPkg(i, useGit));
+    }
+
+    return out;
+}
+
+/** Download packages-meta-ext-v1.json.gz if it's missing or old, and convert it if it changed.
+ * @param force whether to check for a new one, no matter how old the one we have is
+ * @return true if the metadata is now up to date
+ */
+bool update_aur_metadata(const bool force)
+{
+    const path& file_path    = config->cacheDir / AUR_METADATA_FILE;
+    const path& headers_path = path(file_path) += ".headers";
+
+    struct stat file_stat;
+    if (!force && stat(file_path.c_str(), &file_stat) == 0)
+    {
+        // a negative max age means it's never refreshed automatically
+        if (config->metadataMaxAge < 0)
+            return true;
+
+        // the headers file is rewritten every time we check, even if the metadata didn't change.
+        struct stat  check_stat;
+        const time_t last_check = stat(headers_path.c_str(), &check_stat) == 0 ? check_stat.st_mtim.tv_sec
+                                                                               : file_stat.st_mtim.tv_sec;
+
+        if (last_check > std::time(nullptr) - config->metadataMaxAge * 60 * 60)
+            return true;
+    }
+
+    log_println(INFO, _("Refreshing {}"), file_path.string());
+
+    // it's kept compressed, write_aur_metadata() can read it like that
+    bool changed;
+    if (!download_if_modified(AUR_METADATA_URL, file_path, changed, false))
+        return false;
+
+    // convert it now rather than during the next search
+    const path& store_path = config->cacheDir / AUR_METADATA_STORE;
+    if (changed && !write_aur_metadata(file_path, store_path))
+    {
+        log_println(ERROR, _("Failed to open/write {}"), store_path.string());
+        return false;
+    }
+
+    return true;
+}
+
+/** Get the local copy of the AUR's metadata.
+ * It is refreshed if needed and mapped the first time this is called, and shared by every caller after that.
+ * The store is rebuilt if it's missing or older than packages-meta-ext-v1.json.gz, e.g when a new one was copied in.
+ * @return the metadata, or nullptr if there's none we can use
+ */
+const AurMetadata* load_aur_metadata()
+{
+    static AurMetadata metadata;
+    static bool        loaded = false, tried = false;
+
+    if (tried)
+        return loaded ? &metadata : nullptr;
+
+    tried = true;
+
+    const path& file_path  = config->cacheDir / AUR_METADATA_FILE;
+    const path& store_path = config->cacheDir / AUR_METADATA_STORE;
+
+    // if it fails, whatever copy we already have is still better than nothing
+    update_aur_metadata();
+
+    std::error_code ec;
+    const auto&     file_time = std::filesystem::last_write_time(file_path, ec);
+    if (ec)
+    {
+        log_println(ERROR, _("Failed to open {}"), file_path.string());
+        return nullptr;
+    }
+
+    const auto& store_time = std::filesystem::last_write_time(store_path, ec);
+    if ((ec || store_time < file_time) && !write_aur_metadata(file_path, store_path))
+    {
+        log_println(ERROR, _("Failed to open/write {}"), store_path.string());
+        return nullptr;
+    }
+
+    // an older taur might have written it in another format
+    loaded = metadata.load(store_path) || (write_aur_metadata(file_path, store_path) && metadata.load(store_path));
+    if (!loaded)
+        log_println(ERROR, _("Failed to open {}"), store_path.string());
+
+    return loaded ? &metadata : nullptr;
+}
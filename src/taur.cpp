@@ -2,25 +2,100 @@
 // main.cpp simply pieces each function together to make the program work.
 #include "taur.hpp"
 
+#include <rapidjson/istreamwrapper.h>
+
 #include <algorithm>
 #include <array>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <future>
 #include <iterator>
+#include <unordered_map>
+#include <unordered_set>
 
+#include "buildcache.hpp"
 #include "config.hpp"
+#include "makepkg.hpp"
+#include "metadata.hpp"
+#include "rpc.hpp"
 #include "util.hpp"
 
 TaurBackend::TaurBackend(Config& cfg) : config(cfg) {}
 
+/** Take an idle session from the pool, or make a new one if they're all busy.
+ * A session keeps its connection open after a request, so the next one skips the TCP and TLS handshakes,
+ * and HTTP/2 is used whenever the server supports it.
+ * @return the session, give it back with put_session() once done
+ */
+std::unique_ptr<cpr::Session> TaurBackend::get_session()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->sessionsMutex);
+        if (!this->idleSessions.empty())
+        {
+            std::unique_ptr<cpr::Session> session = std::move(this->idleSessions.back());
+            this->idleSessions.pop_back();
+            return session;
+        }
+    }
+
+    std::unique_ptr<cpr::Session> session = std::make_unique<cpr::Session>();
+    session->SetHttpVersion(cpr::HttpVersion{ cpr::HttpVersionCode::VERSION_2_0_TLS });
+    return session;
+}
+
+void TaurBackend::put_session(std::unique_ptr<cpr::Session> session)
+{
+    std::lock_guard<std::mutex> lock(this->sessionsMutex);
+    this->idleSessions.push_back(std::move(session));
+}
+
+/** Send a GET request, reusing an open connection when there's one.
+ * Safe to call from many threads at once.
+ * @param url the url to get
+ * @return the response
+ */
+cpr::Response TaurBackend::http_get(const std::string_view url)
+{
+    std::unique_ptr<cpr::Session> session = this->get_session();
+    session->SetUrl(cpr::Url(url));
+
+    cpr::Response r = session->Get();
+
+    this->put_session(std::move(session));
+    return r;
+}
+
+/** Download a file, reusing an open connection when there's one.
+ * Safe to call from many threads at once.
+ * @param url the url to download
+ * @param out where to write the body
+ * @return the response, without its body
+ */
+cpr::Response TaurBackend::http_download(const std::string_view url, std::ofstream& out)
+{
+    std::unique_ptr<cpr::Session> session = this->get_session();
+    session->SetUrl(cpr::Url(url));
+
+    cpr::Response r = session->Download(out);
+
+    this->put_session(std::move(session));
+    return r;
+}
+
 bool TaurBackend::download_git(const std::string_view url, const path& out_path)
 {
     if (std::filesystem::exists(path(out_path) / ".git"))
     {
-        if (!taur_exec({ config.git.c_str(), "-C", out_path, "pull", "--rebase", "--autostash", "--force" }))
+        // not exiting on failure, this can run in a download thread while others are still going
+        const std::vector<std::string>& pull = { config.git, "-C", out_path, "pull", "--rebase", "--autostash",
+                                                 "--force" };
+        if (!taur_exec(pull, false))
         {
-            // reset and run again
-            return taur_exec({ config.git.c_str(), "-C", out_path, "reset", "--hard", "HEAD" }) &&
-                   download_git(url, out_path);
+            // reset and try once more
+            return taur_exec({ config.git, "-C", out_path, "reset", "--hard", "HEAD" }, false) &&
+                   taur_exec(pull, false);
         }
         return true;
     }
@@ -28,31 +103,37 @@ bool TaurBackend::download_git(const std::string_view url, const path& out_path)
     {
         if (std::filesystem::exists(path(out_path)))
             std::filesystem::remove_all(out_path);
-        return taur_exec({ config.git.c_str(), "clone", url.data(), out_path });
+        return taur_exec({ config.git.c_str(), "clone", url.data(), out_path }, false);
     }
 }
 
+/** Downloads and extracts an AUR snapshot tarball.
+ * @param url a link to the .tar.gz snapshot
+ * @param out_path the folder the package gets extracted to, the tarball is saved next to it as out_path.tar.gz
+ * @returns bool, true = success, false = failure.
+ */
 bool TaurBackend::download_tar(const std::string_view url, const path& out_path)
 {
-    const std::string& out_path_str = out_path.string();
-    std::ofstream      out(out_path_str.substr(0, out_path_str.length() - "tar.gz"_len));
+    path tarball = out_path;
+    if (!hasEnding(tarball.string(), ".tar.gz"))
+        tarball += ".tar.gz";
+
+    std::ofstream out(tarball);
     if (!out.is_open())
         return false;
 
-    cpr::Session session;
-    session.SetUrl(cpr::Url(url));
-    const cpr::Response& r = session.Download(out);
+    const cpr::Response& r = this->http_download(url, out);
+
+    out.close();
 
     if (r.status_code != 200)
         return false;
 
-    out.close();
-
-    // if this is in a directory, it will change to that directory first.
-    if (out_path.has_parent_path())
-        std::filesystem::current_path(out_path.parent_path());
+    // the snapshot contains a folder named after the package, extract it next to the tarball.
+    // not changing the current directory, so this can run in many threads at once
+    const path& extractDir = tarball.has_parent_path() ? tarball.parent_path() : path(".");
 
-    return taur_exec({ "tar", "-xf", out_path.c_str() });
+    return taur_exec({ "tar", "-xf", tarball.string(), "-C", extractDir.string() }, false);
 }
 
 /** Downloads a package from the AUR repository.
@@ -70,123 +151,224 @@ bool TaurBackend::download_pkg(const std::string_view url, const path out_path)
     return false;
 }
 
-static std::string getUrl(const rapidjson::Value& pkgJson, const bool returnGit = false)
+/** Downloads many packages at the same time, up to config.fetchJobs at once.
+ * @param urls the links to download, see download_pkg()
+ * @param out_paths where to download each url
+ * @returns whether each package got downloaded.
+ */
+std::vector<bool> TaurBackend::download_pkgs(std::vector<std::string> const& urls, std::vector<path> const& out_paths)
 {
-    if (returnGit)
-        return fmt::format("https://aur.archlinux.org/{}.git", pkgJson["Name"].GetString());
+    std::vector<char> downloaded(urls.size(), false);
+
+    run_parallel(urls.size(), this->config.fetchJobs,
+                 [&](const size_t i) { downloaded[i] = this->download_pkg(urls[i], out_paths[i]); });
 
-    // URLPath starts with a /
-    return fmt::format("https://aur.archlinux.org{}", pkgJson["URLPath"].GetString());
+    return std::vector<bool>(downloaded.begin(), downloaded.end());
 }
 
-static TaurPkg_t parsePkg(const rapidjson::Value& pkgJson, const bool returnGit = false)
+/** Parse an AUR RPC response held in a string.
+ * @param json the response
+ * @param handler where the packages and the other fields end up
+ * @return false if the JSON is broken, or isn't an RPC response
+ */
+bool parseRpcString(const std::string_view json, RpcHandler& handler)
 {
-    std::vector<std::string> makedepends, depends, totaldepends, licenses;
+    rapidjson::MemoryStream ms(json.data(), json.size());
+    return parseRpc(ms, handler);
+}
 
-    // yes, it will get depends and makedepends even if one doesn't have it
-    if (pkgJson.HasMember("Depends") && pkgJson["Depends"].IsArray())
-    {
-        const rapidjson::Value& dependsArray = pkgJson["Depends"].GetArray();
+// parsing doesn't touch libalpm, so whether a package is installed gets filled in here, on the main thread.
+static void setInstalled(std::vector<TaurPkg_t>& pkgs)
+{
+    alpm_db_t* localdb = alpm_get_localdb(config->handle);
+    for (TaurPkg_t& pkg : pkgs)
+        pkg.installed = alpm_db_get_pkg(localdb, pkg.name.c_str()) != nullptr;
+}
 
-        depends.reserve(dependsArray.Size());
+// RPC responses are cached in cacheDir/.rpc, each file holds the RPC response we got ("Data") and when ("FetchedAt").
+// package names can't start with a dot, so this can't clash with a package directory.
+path getRpcCachePath(const std::string_view name)
+{ return config->cacheDir / ".rpc" / fmt::format("{}.json", name); }
 
-        for (size_t i = 0; i < dependsArray.Size(); ++i)
-            depends.push_back(dependsArray[i].GetString());
+bool readRpcCache(const path& file_path, RpcHandler& handler)
+{
+    std::ifstream file(file_path);
+    if (!file.is_open())
+        return false;
 
-        totaldepends.insert(totaldepends.end(), depends.begin(), depends.end());
-        // for (size_t i = 0; i < makeDependsArray.Size(); ++i) {
-        //     // make sure it isn't in the depends list
-        //     if (std::find(totaldepends.begin(), totaldepends.end(), makeDependsArray[i].GetString()) !=
-        //     totaldepends.end())
-        //         continue;
-        //     totaldepends.push_back(makeDependsArray[i].GetString());
-        // }
-    }
+    rapidjson::IStreamWrapper isw(file);
+    return parseRpc(isw, handler) && handler.fetchedAt >= 0;
+}
 
-    if (pkgJson.HasMember("MakeDepends") && pkgJson["MakeDepends"].IsArray())
-    {
-        const rapidjson::Value& makeDependsArray = pkgJson["MakeDepends"].GetArray();
-        makedepends.reserve(makeDependsArray.Size());
+bool isRpcCacheFresh(const RpcHandler& handler)
+{ return std::time(nullptr) - handler.fetchedAt < config->rpcCacheTTL; }
 
-        for (size_t i = 0; i < makeDependsArray.Size(); ++i)
-            makedepends.push_back(makeDependsArray[i].GetString());
+/** Cache an RPC response.
+ * @param file_path where to write it, see getRpcCachePath()
+ * @param data the JSON of the response, written as is
+ */
+void writeRpcCache(const path& file_path, const std::string_view data)
+{
+    if (config->rpcCacheTTL <= 0 || config->readOnly)
+        return;
 
-        totaldepends.insert(totaldepends.end(), makedepends.begin(), makedepends.end());
-    }
+    std::error_code ec;
+    std::filesystem::create_directories(file_path.parent_path(), ec);
 
-    if (pkgJson.HasMember("License") && pkgJson["License"].IsArray())
+    // write it somewhere else first, so other taur processes never read a half written file.
+    const path&   tmp_path = fmt::format("{}.{}", file_path.string(), getpid());
+    std::ofstream file(tmp_path, std::ios::trunc);
+    if (!file.is_open())
     {
-        const rapidjson::Value& licensesArray = pkgJson["License"].GetArray();
-        licenses.reserve(licensesArray.Size());
-
-        for (size_t i = 0; i < licensesArray.Size(); ++i)
-            licenses.push_back(licensesArray[i].GetString());
+        log_println(DEBUG, "Failed to write the RPC cache file {}", tmp_path.string());
+        return;
     }
 
-    TaurPkg_t out = {
-        .name          = pkgJson["Name"].GetString(),
-        .version       = pkgJson["Version"].GetString(),
-        .aur_url       = getUrl(pkgJson, returnGit),
-        .desc          = pkgJson["Description"].IsString() ? pkgJson["Description"].GetString() : "",
-        .maintainer    = pkgJson["Maintainer"].IsString()
-                             ? pkgJson["Maintainer"].GetString()
-                             : "\1",  // it's impossible that the maintainer name is a binary char
-        .last_modified = pkgJson["LastModified"].GetInt64(),
-        .outofdate     = pkgJson["OutOfDate"].IsInt64() ? pkgJson["OutOfDate"].GetInt64() : 0,
-        .popularity    = pkgJson["Popularity"].GetFloat(),
-        .votes         = pkgJson["NumVotes"].GetFloat(),
-        .licenses      = licenses,
-        .makedepends   = makedepends,
-        .depends       = depends,
-        .totaldepends  = totaldepends,
-        .installed     = alpm_db_get_pkg(alpm_get_localdb(config->handle), pkgJson["Name"].GetString()) != nullptr,
-    };
+    file << "{\"FetchedAt\":" << std::time(nullptr) << ",\"Data\":" << data << '}';
+    file.close();
 
-    return out;
+    std::filesystem::rename(tmp_path, file_path, ec);
 }
 
 std::optional<TaurPkg_t> TaurBackend::fetch_pkg(const std::string_view pkg, const bool returnGit)
 {
-    const std::string&   urlStr = "https://aur.archlinux.org/rpc/v5/info/" + cpr::util::urlEncode(pkg.data());
-    const cpr::Response& resp   = cpr::Get(cpr::Url(urlStr));
+    std::vector<TaurPkg_t> pkgs = this->fetch_pkgs({ std::string(pkg) }, returnGit);
 
-    if (resp.status_code != 200)
+    if (pkgs.empty())
         return {};
 
-    rapidjson::Document json;
-    json.Parse(resp.text.c_str());
-
-    if (json["resultcount"].GetInt() > 0)
-        return parsePkg(json["results"][0], returnGit);
-
-    return {};
+    return std::move(pkgs[0]);
 }
 
-std::vector<TaurPkg_t> TaurBackend::fetch_pkgs(std::vector<std::string> const& pkgs, const bool returnGit)
+/** Get the information of many AUR packages, from the local AUR metadata if it's enabled, else from the RPC cache and
+ * batched info requests. Packages missing from the local metadata, e.g uploaded since it was downloaded, are looked up
+ * on the AUR too, unless metadataMaxAge is negative. Packages that aren't on the AUR are left out.
+ * @param pkgs the package names
+ * @param returnGit whether the packages should use a .git url
+ * @param failed if not null, set to whether some of the info requests failed
+ * @return the packages that were found, not necessarily in the same order
+ */
+std::vector<TaurPkg_t> TaurBackend::fetch_pkgs(std::vector<std::string> const& pkgs, const bool returnGit,
+                                               bool* failed)
 {
+    if (failed)
+        *failed = false;
+
     if (pkgs.empty())
         return {};
 
-    std::string urlStr{ "https://aur.archlinux.org/rpc/v5/info?arg%5B%5D=" + pkgs[0] };
-    urlStr.reserve(pkgs.size());
+    std::vector<TaurPkg_t> out;
+    out.reserve(pkgs.size());
+
+    // what the local metadata doesn't have, if it's used
+    std::vector<std::string> missing;
+    bool                     usedMetadata = false;
+
+    // loading the local metadata may rebuild its store
+    if (config.localMetadata && !config.readOnly)
+    {
+        if (const AurMetadata* metadata = load_aur_metadata())
+        {
+            usedMetadata = true;
+            for (const std::string& pkg : pkgs)
+            {
+                if (std::optional<TaurPkg_t> found = metadata->find(pkg, returnGit))
+                    out.push_back(std::move(*found));
+                else
+                    missing.push_back(pkg);
+            }
+
+            // a negative metadataMaxAge is for machines that can't reach the AUR
+            if (missing.empty() || config.metadataMaxAge < 0)
+            {
+                setInstalled(out);
+                return out;
+            }
 
-    for (size_t i = 1; i < pkgs.size(); ++i)
-        urlStr += ("&arg%5B%5D=" + pkgs[i]);
+            log_println(DEBUG, "Not in the local AUR metadata, asking the AUR: {}", missing);
+        }
+        else
+            log_println(DEBUG, "The local AUR metadata isn't available, asking the AUR");
+    }
 
-    log_println(DEBUG, "info url = {}", urlStr);
+    // serve whatever we can from the cache, everything else gets (re)validated in bulk below.
+    std::vector<std::string>                                toFetch;
+    std::unordered_map<std::string, std::vector<TaurPkg_t>> staleRecords;
 
-    const cpr::Response& resp = cpr::Get(cpr::Url(urlStr));
+    for (const std::string& pkg : usedMetadata ? missing : pkgs)
+    {
+        RpcHandler cached(returnGit, true, false);
+        if (config.rpcCacheTTL > 0 && readRpcCache(getRpcCachePath(pkg), cached))
+        {
+            if (isRpcCacheFresh(cached))
+            {
+                std::move(cached.pkgs.begin(), cached.pkgs.end(), std::back_inserter(out));
+                continue;
+            }
 
-    if (resp.status_code != 200)
-        return {};
+            staleRecords.emplace(pkg, std::move(cached.pkgs));
+        }
 
-    rapidjson::Document json;
-    json.Parse(resp.text.c_str());
+        toFetch.push_back(pkg);
+    }
 
-    std::vector<TaurPkg_t> out;
-    out.reserve(json["resultcount"].GetInt());
-    for (int i = 0; i < json["resultcount"].GetInt(); ++i)
-        out.push_back(parsePkg(json["results"][i], returnGit));
+    if (!toFetch.empty())
+    {
+        // the RPC accepts many packages per request, so we split the list into as few urls as the server accepts,
+        // and send them all at once.
+        const std::vector<std::pair<std::string, size_t>>& urls =
+            make_info_urls(toFetch, std::max<std::int64_t>(config.rpcMaxUrlLength, 1));
+
+        std::vector<std::unique_ptr<RpcHandler>> handlers;
+        for (size_t i = 0; i < urls.size(); ++i)
+            handlers.push_back(std::make_unique<RpcHandler>(returnGit, false, config.rpcCacheTTL > 0));
+
+        std::vector<char> parsed(urls.size(), false);
+
+        run_parallel(urls.size(), AUR_RPC_MAX_JOBS, [&](const size_t batch) {
+            const cpr::Response& resp = this->http_get(urls[batch].first);
+            log_println(DEBUG, "info url = {}", resp.url.str());
+
+            parsed[batch] = resp.status_code == 200 && parseRpcString(resp.text, *handlers[batch]);
+        });
+
+        for (size_t batch = 0; batch < urls.size(); ++batch)
+        {
+            RpcHandler& handler = *handlers[batch];
+
+            if (!parsed[batch])
+            {
+                if (failed)
+                    *failed = true;
+
+                // better outdated than nothing
+                const auto& [begin, end] = info_url_range(urls, batch);
+
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const auto& it = staleRecords.find(toFetch[i]);
+                    if (it == staleRecords.end())
+                        continue;
+
+                    log_println(DEBUG, "Couldn't revalidate {}, using the cached copy", toFetch[i]);
+                    std::move(it->second.begin(), it->second.end(), std::back_inserter(out));
+                }
+
+                continue;
+            }
+
+            for (size_t i = 0; i < handler.pkgs.size(); ++i)
+            {
+                if (i < handler.records.size())
+                    writeRpcCache(getRpcCachePath(handler.pkgs[i].name),
+                                  fmt::format("{{\"resultcount\":1,\"results\":[{}]}}", handler.records[i]));
+
+                out.push_back(std::move(handler.pkgs[i]));
+            }
+        }
+    }
+
+    setInstalled(out);
 
     return out;
 }
@@ -271,240 +453,814 @@ bool TaurBackend::remove_pkgs(const alpm_list_smart_pointer& pkgs)
     return true;
 }
 
-bool TaurBackend::build_pkg(const std::string_view pkg_name, const std::string_view extracted_path,
-                            const bool alreadyprepared)
+/** Get the package files of the package that was asked for, the PKGBUILD may build others (split and debug packages).
+ */
+std::vector<std::string> BuildResult_t::pkgArtifacts() const
+{
+    std::vector<std::string> ret;
+    for (const std::string& artifact : this->artifacts)
+        if (package_file_pkgname(artifact) == this->pkgname)
+            ret.push_back(artifact);
+
+    return ret;
+}
+
+/** Check whether the package that was asked for is built already.
+ * The others may never be, e.g there's no debug package when there was nothing to strip.
+ */
+bool BuildResult_t::built() const
+{
+    const std::vector<std::string>& files = this->pkgArtifacts();
+    return !files.empty() && std::all_of(files.begin(), files.end(), [](const std::string& file) {
+        std::error_code ec;
+        return std::filesystem::exists(file, ec);
+    });
+}
+
+/** Install the packages that were asked for in a single transaction.
+ * @param results what TaurBackend::build_pkgs() said to install
+ * @return true if pacman installed them, or there was nothing to install
+ */
+bool install_builds(const std::vector<BuildResult_t>& results)
+{
+    std::vector<std::string> files;
+    for (const BuildResult_t& result : results)
+        for (std::string& file : result.pkgArtifacts())
+            files.push_back(std::move(file));
+
+    log_println(DEBUG, "installing {}", files);
+    return files.empty() || pacman_exec("-U", files, false);
+}
+
+/** Get what a package builds, ready to be filled by makepkg.
+ * @return false if makepkg couldn't tell
+ */
+static bool get_build_result(const std::string_view pkg_name, const path& pkg_dir, BuildResult_t& result)
 {
-    std::filesystem::current_path(extracted_path);
+    std::optional<std::vector<std::string>> artifacts = get_packagelist(pkg_dir);
+    if (!artifacts)
+    {
+        log_println(ERROR, _("Failed to list the packages {}'s PKGBUILD builds"), pkg_name);
+        return false;
+    }
+
+    result = { std::string(pkg_name), std::move(*artifacts) };
+    log_println(DEBUG, "{} builds {}", pkg_name, result.artifacts);
+
+    if (result.pkgArtifacts().empty())
+    {
+        log_println(ERROR, _("{}'s PKGBUILD doesn't build {}"), pkg_name, pkg_name);
+        return false;
+    }
 
+    return true;
+}
+
+bool TaurBackend::build_pkg(const std::string_view pkg_name, const std::string_view extracted_path,
+                            BuildResult_t& result, const bool alreadyprepared, const bool sourcesVerified)
+{
     if (!alreadyprepared)
     {
-        log_println(INFO, _("Verifying package sources.."));
-        makepkg_exec({ "--verifysource", "--skippgpcheck", "-fs", "-Cc" });
+        if (!sourcesVerified)
+        {
+            log_println(INFO, _("Verifying package sources.."));
+            makepkg_exec({ "--verifysource", "--skippgpcheck", "-fs", "-Cc" }, true, extracted_path);
+        }
 
         log_println(INFO, _("Preparing for compilation.."));
-        makepkg_exec({ "--nobuild", "--skippgpcheck", "-fs", "-C", "--ignorearch" });
+        makepkg_exec({ "--nobuild", "--skippgpcheck", "-fs", "-C", "--ignorearch" }, true, extracted_path);
     }
 
-    built_pkg = makepkg_list(pkg_name.data(), extracted_path);
-    log_println(DEBUG, "built_pkg = {}", built_pkg);
+    if (!get_build_result(pkg_name, extracted_path, result))
+        return false;
 
-    if (!std::filesystem::exists(built_pkg))
+    if (!result.built())
     {
         /*log_println(INFO, _("Compiling {} in 3 seconds, you can cancel at this point if you can't compile."),
         pkg_name); sleep(3);*/
 
         return makepkg_exec(
             { "-fs", "--noconfirm", "--noextract", "--noprepare", "--nocheck", "--holdver", "--ignorearch", "-c" },
-            false);
+            false, extracted_path);
     }
     else
-        log_println(INFO, _("{} exists already, skipping..."), built_pkg);
+        log_println(INFO, _("{} exists already, skipping..."), fmt::join(result.pkgArtifacts(), " "));
 
     return true;
 }
 
-// I don't know but I feel this is shitty, atleast it works great
-bool TaurBackend::handle_aur_depends(const TaurPkg_t& pkg, const path& out_path,
-                                     std::vector<TaurPkg_t> const& localPkgs, const bool useGit)
+/** Find which packages of a list depend on which other packages of the same list.
+ * Dependencies that aren't in the list are ignored.
+ * @param count how many packages there are
+ * @param getPkg returns the package at the given index
+ * @return for each package, the indices of the packages it depends on
+ */
+template <typename GetPkg>
+static std::vector<std::vector<size_t>> getDependencies(const size_t count, GetPkg&& getPkg)
 {
-    log_println(DEBUG, "pkg.name = {}", pkg.name);
-    log_println(DEBUG, "pkg.totaldepends = {}", pkg.totaldepends);
-    const std::vector<std::string>& aur_list = load_aur_list();
+    std::unordered_map<std::string_view, size_t> indices;
+    for (size_t i = 0; i < count; ++i)
+        indices.emplace(getPkg(i).name, i);
+
+    std::vector<std::vector<size_t>> dependencies(count);
 
-    for (size_t i = 0; i < pkg.totaldepends.size(); ++i)
+    for (size_t i = 0; i < count; ++i)
     {
-        std::string_view pkg_depend;
+        for (const std::string_view depend : getPkg(i).totaldepends)
+        {
+            const auto& it = indices.find(getDependName(depend));
+            if (it == indices.end() || it->second == i)
+                continue;
 
-        if (std::binary_search(aur_list.begin(), aur_list.end(), pkg.totaldepends.at(i)))
-            pkg_depend = pkg.totaldepends.at(i);
+            if (std::find(dependencies[i].begin(), dependencies[i].end(), it->second) == dependencies[i].end())
+                dependencies[i].push_back(it->second);
+        }
+    }
 
-        if (pkg_depend.empty())
-            continue;
+    return dependencies;
+}
 
-        const std::optional<TaurPkg_t>& oDepend = this->fetch_pkg(pkg_depend, useGit);
-        if (!oDepend)
-            continue;
+/** Sort indices so that every index comes after the indices it depends on.
+ * @param dependencies what getDependencies() returned
+ * @return the sorted indices, if there's a dependency cycle, the indices in it are put at the end.
+ */
+std::vector<size_t> sortIndices(const std::vector<std::vector<size_t>>& dependencies)
+{
+    const size_t count = dependencies.size();
 
-        const TaurPkg_t& depend = oDepend.value();
+    // how many dependencies of each index are left to sort, and who depends on it
+    std::vector<size_t>              pending(count, 0);
+    std::vector<std::vector<size_t>> dependents(count);
 
-        log_println(DEBUG, "depend = {} -- depend.totaldepends = {}", depend.name, depend.totaldepends);
+    for (size_t i = 0; i < count; ++i)
+    {
+        pending[i] = dependencies[i].size();
+        for (const size_t dependency : dependencies[i])
+            dependents[dependency].push_back(i);
+    }
+
+    std::vector<size_t> order;
+    order.reserve(count);
+
+    for (size_t i = 0; i < count; ++i)
+        if (pending[i] == 0)
+            order.push_back(i);
+
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        for (const size_t dependent : dependents[order[i]])
+            if (--pending[dependent] == 0)
+                order.push_back(dependent);
+    }
+
+    if (order.size() != count)
+    {
+        log_println(WARN, _("Found a dependency cycle, the build order might be wrong."));
+
+        for (size_t i = 0; i < count; ++i)
+            if (pending[i] > 0)
+                order.push_back(i);
+    }
+
+    return order;
+}
+
+/** Sort packages so that every package comes after the packages it depends on.
+ * Dependencies that aren't in pkgs are ignored.
+ * @param pkgs the packages to sort
+ * @return the sorted packages, if there's a dependency cycle, the packages in it are put at the end.
+ */
+std::vector<TaurPkg_t> sortByDepends(std::vector<TaurPkg_t>&& pkgs)
+{
+    const std::vector<size_t>& order =
+        sortIndices(getDependencies(pkgs.size(), [&pkgs](const size_t i) -> const TaurPkg_t& { return pkgs[i]; }));
+
+    std::vector<TaurPkg_t> out;
+    out.reserve(pkgs.size());
+
+    for (const size_t i : order)
+        out.push_back(std::move(pkgs[i]));
+
+    return out;
+}
+
+/** Find every AUR package that pkgs depend on, directly or not.
+ * The dependency graph is walked one level at a time, each level is fetched with batched info requests.
+ * @param pkgs the packages to resolve the dependencies of
+ * @param localPkgs the installed AUR packages, these won't be returned
+ * @param useGit whether the returned packages should use a .git url
+ * @return the dependencies that need to be built, sorted in the order they should be built.
+ */
+std::vector<TaurPkg_t> TaurBackend::resolve_aur_depends(const std::vector<TaurPkg_t>& pkgs,
+                                                        std::vector<TaurPkg_t> const& localPkgs, const bool useGit)
+{
+    const AurList& aur_list      = load_aur_list();
+    alpm_list_t*   localPkgcache = alpm_db_get_pkgcache(alpm_get_localdb(config.handle));
+
+    std::unordered_set<std::string_view> installed;
+    for (const TaurPkg_t& localPkg : localPkgs)
+        installed.insert(localPkg.name);
+
+    // every package we have seen so far, so we don't fetch anything twice.
+    std::unordered_set<std::string> seen;
+    for (const TaurPkg_t& pkg : pkgs)
+        seen.insert(pkg.name);
 
-        bool alreadyExists = false;
-        for (size_t j = 0; (j < localPkgs.size() && !alreadyExists); ++j)
+    std::vector<std::string> level;
+
+    const auto& addDepends = [&](const TaurPkg_t& pkg) {
+        for (const std::string_view depend : pkg.totaldepends)
         {
-            if (depend.name == localPkgs[j].name)
-            {
-                alreadyExists = true;
-                break;
-            }
+            const std::string_view name = getDependName(depend);
+
+            // interned strings are null-terminated
+            if (installed.contains(name) || !aur_list.contains(name) ||
+                alpm_find_satisfier(localPkgcache, depend.data()))
+                continue;
+
+            if (seen.emplace(name).second)
+                level.emplace_back(name);
         }
+    };
+
+    for (const TaurPkg_t& pkg : pkgs)
+        addDepends(pkg);
 
-        if (alreadyExists)
+    std::vector<TaurPkg_t> depends;
+
+    while (!level.empty())
+    {
+        log_println(DEBUG, "fetching dependencies: {}", level);
+
+        std::vector<TaurPkg_t> fetched = this->fetch_pkgs(level, useGit);
+
+        if (fetched.size() != level.size())
+            log_println(WARN, _("Couldn't get all dependencies! (searched {} packages, got {})"), level.size(),
+                        fetched.size());
+
+        level.clear();
+
+        for (TaurPkg_t& depend : fetched)
         {
-            log_println(DEBUG, "dependency {} already exists, skipping!", depend.name);
+            addDepends(depend);
+            depends.push_back(std::move(depend));
+        }
+    }
+
+    return sortByDepends(std::move(depends));
+}
+
+/** Resolve and download the AUR dependencies of the packages we're about to build, and add them to the build.
+ * @param jobs the packages we're about to build, their dependencies get added in front of them
+ * @param out_path where to download the dependencies
+ * @param localPkgs the installed AUR packages
+ * @param useGit whether the dependencies should be downloaded with git
+ * @return false if a dependency couldn't be downloaded, the others are still added
+ */
+bool TaurBackend::handle_aur_depends(std::vector<BuildJob_t>& jobs, const path& out_path,
+                                     std::vector<TaurPkg_t> const& localPkgs, const bool useGit)
+{
+    std::vector<TaurPkg_t> pkgs;
+    pkgs.reserve(jobs.size());
+
+    for (const BuildJob_t& job : jobs)
+    {
+        log_println(DEBUG, "pkg.name = {}", job.pkg.name);
+        log_println(DEBUG, "pkg.totaldepends = {}", job.pkg.totaldepends);
+        pkgs.push_back(job.pkg);
+    }
+
+    std::vector<TaurPkg_t> depends = this->resolve_aur_depends(pkgs, localPkgs, useGit);
+
+    std::vector<std::string> urls;
+    std::vector<path>        dirs;
+    urls.reserve(depends.size());
+    dirs.reserve(depends.size());
+
+    for (const TaurPkg_t& depend : depends)
+    {
+        log_println(DEBUG, "depend = {} -- depend.totaldepends = {}", depend.name, depend.totaldepends);
+        log_println(INFO, _("Downloading dependency {}"), depend.name);
+
+        urls.push_back(depend.aur_url);
+        dirs.push_back(out_path / depend.name);
+    }
+
+    const std::vector<bool>& downloaded = this->download_pkgs(urls, dirs);
+
+    std::vector<BuildJob_t> dependJobs;
+    dependJobs.reserve(depends.size());
+
+    bool ret = true;
+
+    for (size_t i = 0; i < depends.size(); ++i)
+    {
+        if (!downloaded[i])
+        {
+            log_println(ERROR, _("Failed to download dependency {} (Source: {})"), depends[i].name, urls[i]);
+            ret = false;
             continue;
         }
 
-        for (size_t i = 0; i < depend.totaldepends.size(); ++i)
+        dependJobs.push_back({ std::move(depends[i]), std::move(dirs[i]) });
+    }
+
+    jobs.insert(jobs.begin(), std::make_move_iterator(dependJobs.begin()), std::make_move_iterator(dependJobs.end()));
+
+    return ret;
+}
+
+// where build_job() writes makepkg's output, inside the package's folder
+static constexpr std::string_view BUILD_LOG_NAME = "taur-build.log";
+
+/** Build a package without installing it, writing makepkg's output to BUILD_LOG_NAME in its folder.
+ * Doesn't call into libalpm and doesn't change the current directory, so it can run in many threads at once.
+ * The sources have to be verified already (see fetch_sources()),
+ * and the build dependencies installed, as makepkg isn't allowed to call pacman.
+ * @param job the package to build
+ * @param result set to what it builds
+ * @return true if the package got built
+ */
+static bool build_job(const BuildJob_t& job, BuildResult_t& result)
+{
+    const path& logFile = job.dir / BUILD_LOG_NAME;
+
+    log_println(INFO, _("Building {}..."), job.pkg.name);
+
+    if (!job.alreadyprepared &&
+        !makepkg_exec({ "--nobuild", "--skippgpcheck", "-f", "-C", "--ignorearch" }, false, job.dir, logFile))
+        return false;
+
+    if (!get_build_result(job.pkg.name, job.dir, result))
+        return false;
+
+    if (result.built())
+    {
+        log_println(INFO, _("{} exists already, skipping..."), fmt::join(result.pkgArtifacts(), " "));
+        return true;
+    }
+
+    if (!makepkg_exec({ "-f", "--noextract", "--noprepare", "--nocheck", "--holdver", "--ignorearch", "-c" }, false,
+                      job.dir, logFile))
+        return false;
+
+    log_println(INFO, _("Built {}"), job.pkg.name);
+    return true;
+}
+
+/** Download and verify the sources of every job that isn't prepared already, up to fetchJobs at the same time.
+ * When more than one runs at once, makepkg's output goes to BUILD_LOG_NAME in each package folder.
+ * @param jobs the packages about to be built
+ * @param fetchJobs how many packages can fetch their sources at the same time
+ * @param cached the jobs that were taken from the build cache, these aren't built so they don't need their sources
+ * @param failed set to true for each job whose sources couldn't be fetched
+ */
+static void fetch_sources(const std::vector<BuildJob_t>& jobs, const std::int64_t fetchJobs,
+                          const std::vector<char>& cached, std::vector<char>& failed)
+{
+    std::vector<size_t> toFetch;
+    for (size_t i = 0; i < jobs.size(); ++i)
+        if (!jobs[i].alreadyprepared && !cached[i])
+            toFetch.push_back(i);
+
+    if (toFetch.empty())
+        return;
+
+    log_println(INFO, _("Verifying package sources.."));
+
+    run_parallel(toFetch.size(), fetchJobs, [&](const size_t j) {
+        const BuildJob_t& job     = jobs[toFetch[j]];
+        const path&       logFile = fetchJobs > 1 ? job.dir / BUILD_LOG_NAME : path();
+
+        if (!makepkg_exec({ "--verifysource", "--skippgpcheck", "-f", "-Cc" }, false, job.dir, logFile))
         {
-            std::string_view sub_pkg_depend;
+            if (logFile.empty())
+                log_println(ERROR, _("Failed to fetch the sources of {}"), job.pkg.name);
+            else
+                log_println(ERROR, _("Failed to fetch the sources of {}, see {}"), job.pkg.name, logFile.string());
+            failed[toFetch[j]] = true;
+        }
+    });
+}
 
-            if (std::binary_search(aur_list.begin(), aur_list.end(), depend.totaldepends.at(i)))
-                sub_pkg_depend = depend.totaldepends.at(i);
+/** Install from the repositories the dependencies of every job that aren't installed yet,
+ * and that no other job builds, so makepkg doesn't have to (see build_job()).
+ * @param jobs the packages about to be built
+ * @param handle the alpm handle, used to look at the installed packages
+ */
+static void install_repo_depends(const std::vector<BuildJob_t>& jobs, alpm_handle_t* handle)
+{
+    alpm_list_t* localPkgcache = alpm_db_get_pkgcache(alpm_get_localdb(handle));
 
-            if (sub_pkg_depend.empty())
+    std::unordered_set<std::string_view> building;
+    for (const BuildJob_t& job : jobs)
+        building.insert(job.pkg.name);
+
+    std::unordered_set<std::string_view> seen;
+    std::vector<std::string>             missing;
+
+    for (const BuildJob_t& job : jobs)
+    {
+        for (const std::string_view depend : job.pkg.totaldepends)
+        {
+            // interned strings are null-terminated
+            if (building.contains(getDependName(depend)) || alpm_find_satisfier(localPkgcache, depend.data()))
                 continue;
 
-            const std::optional<TaurPkg_t>& oSubDepend = this->fetch_pkg(sub_pkg_depend, useGit);
-            if (!oDepend)
+            if (seen.insert(depend).second)
+                missing.emplace_back(depend);
+        }
+    }
+
+    if (missing.empty())
+        return;
+
+    log_println(INFO, _("Installing build dependencies: {}"), fmt::join(missing, " "));
+    if (!pacman_exec("-S", missing, false, true, { "--needed", "--asdeps" }))
+        log_println(WARN,
+                    _("Failed to install some build dependencies, the packages needing them will fail to build."));
+}
+
+/** Build a set of packages, in dependency order.
+ * If config.buildCache is on, the packages that were built before from the exact same recipe are copied from the build
+ * cache instead, and the ones that get built are added to it.
+ * The sources of every package are fetched first, up to config.fetchJobs at once, before anything gets built.
+ * If config.buildJobs is more than 1, up to that many packages are built at the same time, each one as soon as the
+ * packages of the set it depends on are installed, each build writing its output to BUILD_LOG_NAME in its folder.
+ * Packages that another package of the set depends on are installed right after being built,
+ * the others are added to toInstall, so the caller can install them all in a single transaction (see install_builds()).
+ * @param jobs the packages to build
+ * @param toInstall filled with what got built and still has to be installed
+ * @return the names of the packages that failed to build or to install, or whose dependencies did
+ */
+std::vector<std::string> TaurBackend::build_pkgs(const std::vector<BuildJob_t>& jobs,
+                                                 std::vector<BuildResult_t>& toInstall)
+{
+    const std::vector<std::vector<size_t>>& dependencies =
+        getDependencies(jobs.size(), [&jobs](const size_t i) -> const TaurPkg_t& { return jobs[i].pkg; });
+
+    const std::vector<size_t>& order = sortIndices(dependencies);
+
+    std::vector<bool> hasDependents(jobs.size(), false);
+    for (const std::vector<size_t>& jobDependencies : dependencies)
+        for (const size_t dependency : jobDependencies)
+            hasDependents[dependency] = true;
+
+    std::vector<char>          failed(jobs.size(), false);
+    std::vector<BuildResult_t> built(jobs.size());
+
+    std::vector<std::string> cacheKeys(jobs.size());
+    std::vector<char>        cached(jobs.size(), false);
+
+    if (this->config.buildCache)
+    {
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            cacheKeys[i] = build_cache_key(jobs[i].pkg.name, jobs[i].dir);
+            log_println(DEBUG, "build cache key of {} = {}", jobs[i].pkg.name, cacheKeys[i]);
+
+            if (cacheKeys[i].empty())
                 continue;
 
-            const TaurPkg_t& subDepend = oSubDepend.value();
+            if (!get_build_result(jobs[i].pkg.name, jobs[i].dir, built[i]))
+                continue;
 
-            alreadyExists = false;
-            for (size_t j = 0; (j < localPkgs.size() && !alreadyExists); ++j)
-            {
-                if (subDepend.name == localPkgs[j].name)
-                {
-                    alreadyExists = true;
-                    break;
-                }
-            }
+            // every package file is in the same folder, PKGDEST or the package's
+            cached[i] = restore_cached_build(cacheKeys[i], path(built[i].artifacts.front()).parent_path()) &&
+                        built[i].built();
+
+            if (cached[i])
+                log_println(INFO, _("Using {} from the build cache"), jobs[i].pkg.name);
+        }
+    }
+
+    const auto& storeBuild = [&](const size_t i) {
+        if (!cacheKeys[i].empty() && !store_cached_build(cacheKeys[i], built[i].artifacts))
+            log_println(WARN, _("Failed to store {} in the build cache"), jobs[i].pkg.name);
+    };
 
-            if (alreadyExists)
+    const auto& skipIfDependencyFailed = [&](const size_t i) {
+        for (const size_t dependency : dependencies[i])
+        {
+            if (failed[dependency])
             {
-                log_println(DEBUG, "dependency of {} ({}) already exists, skipping!", depend.name, subDepend.name);
-                continue;
+                log_println(ERROR, _("Skipping {}, its dependency {} has failed."), jobs[i].pkg.name,
+                            jobs[dependency].pkg.name);
+                failed[i] = true;
+                return true;
             }
+        }
+        return false;
+    };
 
-            std::string filename = out_path / subDepend.aur_url.substr(subDepend.aur_url.rfind('/') + 1);
+    // the logs of the previous builds
+    for (const BuildJob_t& job : jobs)
+    {
+        std::error_code ec;
+        std::filesystem::remove(job.dir / BUILD_LOG_NAME, ec);
+    }
 
-            if (useGit)
-                filename = filename.substr(0, filename.rfind(".git"));
+    fetch_sources(jobs, this->config.fetchJobs, cached, failed);
 
-            log_println(DEBUG, "Downloading dependency {} of dependency {}.", subDepend.name, depend.name);
-            if (!this->download_pkg(subDepend.aur_url, filename))
-            {
-                log_println(ERROR, _("Failed to download dependency {} of dependency {}."), subDepend.name,
-                            depend.name);
+    if (this->config.buildJobs <= 1)
+    {
+        for (const size_t i : order)
+        {
+            if (failed[i] || skipIfDependencyFailed(i))
                 continue;
-            }
 
-            log_println(DEBUG, "Handling dependencies for dependency {} of dependency {}.", subDepend.name,
-                        depend.name);
-            if (!depend.totaldepends.empty() && !handle_aur_depends(subDepend, out_path, localPkgs, useGit))
+            if (!cached[i])
             {
-                log_println(ERROR, _("Failed to handle dependencies for dependency {} of dependency {}."),
-                            subDepend.name, depend.name);
-                continue;
-            }
+                if (!this->build_pkg(jobs[i].pkg.name, jobs[i].dir.string(), built[i], jobs[i].alreadyprepared, true))
+                {
+                    log_println(ERROR, _("Building '{}' has failed."), jobs[i].pkg.name);
+                    failed[i] = true;
+                    continue;
+                }
 
-            if (!useGit)
-                filename = filename.substr(0, filename.rfind(".tar.gz"));
+                storeBuild(i);
+            }
 
-            log_println(DEBUG, "Installing dependency {} of dependency {}.", subDepend.name, depend.name);
-            if (!this->build_pkg(subDepend.name, filename, false))
+            if (hasDependents[i] && !pacman_exec("-U", built[i].pkgArtifacts(), false))
             {
-                log_println(ERROR, _("Failed to compile dependency {} of dependency {}."), subDepend.name, depend.name);
-                continue;
+                log_println(ERROR, _("Failed to install {}"), jobs[i].pkg.name);
+                failed[i] = true;
             }
+        }
+    }
+    else
+    {
+        install_repo_depends(jobs, this->config.handle);
+
+        // a job is ready once the dependencies sorted before it are done, the ones sorted after it are in a
+        // dependency cycle with it and are ignored, just like when building one package at a time.
+        std::vector<size_t> position(jobs.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            position[order[i]] = i;
 
-            log_println(DEBUG, "Installing dependency {} of dependency {}.", subDepend.name, depend.name);
-            if (!pacman_exec("-U", split(built_pkg, ' '), false))
+        std::vector<size_t>              waiting(jobs.size(), 0);
+        std::vector<std::vector<size_t>> dependents(jobs.size());
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            for (const size_t dependency : dependencies[i])
             {
-                log_println(ERROR, _("Failed to install dependency {} of dependency {}."), subDepend.name, depend.name);
-                continue;
+                if (position[dependency] < position[i])
+                {
+                    ++waiting[i];
+                    dependents[dependency].push_back(i);
+                }
             }
         }
 
-        log_println(INFO, _("Downloading dependency {}"), depend.name);
+        // guards the queue, the counters and failed
+        std::mutex              mutex;
+        std::condition_variable readyChanged;
+        std::deque<size_t>      ready;
+        size_t                  unfinished = jobs.size();
 
-        std::string filename = out_path / depend.aur_url.substr(depend.aur_url.rfind('/') + 1);
+        // only one pacman can run at once, and the other builds keep going meanwhile
+        std::mutex installMutex;
 
-        if (useGit)
-            filename = filename.substr(0, filename.rfind(".git"));
+        // called with mutex locked, once a job is built and installed, or has failed
+        const auto& finish = [&](const size_t done) {
+            std::vector<size_t> finished{ done };
+            while (!finished.empty())
+            {
+                const size_t i = finished.back();
+                finished.pop_back();
+                --unfinished;
 
-        bool downloadStatus = this->download_pkg(depend.aur_url, filename);
+                for (const size_t dependent : dependents[i])
+                {
+                    if (--waiting[dependent] > 0)
+                        continue;
 
-        if (!downloadStatus)
-        {
-            log_println(ERROR, _("Failed to download dependency of {} (Source: {})"), pkg.name, depend.aur_url);
-            return false;
-        }
+                    if (failed[dependent] || skipIfDependencyFailed(dependent))
+                        finished.push_back(dependent);
+                    else
+                        ready.push_back(dependent);
+                }
+            }
 
-        bool installStatus = this->build_pkg(depend.name, (out_path / depend.name).string(), false);
+            readyChanged.notify_all();
+        };
 
-        if (!installStatus)
         {
-            log_println(ERROR, _("Failed to install dependency of {} ({})"), pkg.name, depend.name);
-            return false;
-        }
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const size_t i : order)
+            {
+                if (waiting[i] > 0)
+                    continue;
 
-        log_println(DEBUG, "Installing dependency of {} ({}).", pkg.name, depend.name);
-        if (!pacman_exec("-U", split(built_pkg, ' '), false))
-        {
-            log_println(ERROR, _("Failed to install dependency of {} ({})."), pkg.name, depend.name);
-            return false;
+                if (failed[i])
+                    finish(i);
+                else
+                    ready.push_back(i);
+            }
         }
-    }
 
-    return true;
-}
+        const size_t workers = std::min<size_t>(this->config.buildJobs, jobs.size());
 
-bool TaurBackend::update_all_aur_pkgs(const path& cacheDir, const bool useGit)
-{
-    const std::vector<TaurPkg_t>& localPkgs = this->get_all_local_pkgs(true);
+        run_parallel(workers, workers, [&](const size_t) {
+            std::unique_lock<std::mutex> lock(mutex);
 
-    if (localPkgs.empty())
+            while (true)
+            {
+                readyChanged.wait(lock, [&]() { return !ready.empty() || unfinished == 0; });
+                if (ready.empty())
+                    return;
+
+                const size_t i = ready.front();
+                ready.pop_front();
+                lock.unlock();
+
+                bool success = cached[i];
+                if (!success)
+                {
+                    success = build_job(jobs[i], built[i]);
+                    if (success)
+                        storeBuild(i);
+                    else
+                        log_println(ERROR, _("Building '{}' has failed, see {}"), jobs[i].pkg.name,
+                                    (jobs[i].dir / BUILD_LOG_NAME).string());
+                }
+
+                // the packages depending on it need it installed
+                if (success && hasDependents[i])
+                {
+                    std::lock_guard<std::mutex> installLock(installMutex);
+                    if (!pacman_exec("-U", built[i].pkgArtifacts(), false))
+                    {
+                        log_println(ERROR, _("Failed to install {}"), jobs[i].pkg.name);
+                        success = false;
+                    }
+                }
+
+                lock.lock();
+                failed[i] = !success;
+                finish(i);
+            }
+        });
+    }
+
+    std::vector<std::string> failedNames;
+
+    for (const size_t i : order)
     {
-        log_println(INFO, _("No AUR packages found in your system."));
-        return true;
+        if (failed[i])
+            failedNames.push_back(jobs[i].pkg.name);
+        else if (!hasDependents[i])
+            toInstall.push_back(std::move(built[i]));
     }
 
-    std::string              line;
+    log_println(DEBUG, "failed to build = {}", failedNames);
+
+    return failedNames;
+}
+
+/** Find which installed AUR packages have a newer version on the AUR, with batched info requests.
+ * Development (-git) packages are always candidates, their real version is only known once their sources are fetched.
+ * Nothing is downloaded or written, besides the RPC cache.
+ * @param localPkgs the installed AUR packages, see get_all_local_pkgs()
+ * @param useGit whether the AUR packages should use a .git url
+ * @param failed if not null, set to whether some of the info requests failed, instead of warning about missing packages
+ * @return the candidates, in the same order as localPkgs
+ */
+std::vector<UpgradeCandidate_t> TaurBackend::computeUpgradeCandidates(const std::vector<TaurPkg_t>& localPkgs,
+                                                                      const bool useGit, bool* failed)
+{
     std::vector<std::string> pkgNames;
     pkgNames.reserve(localPkgs.size());
 
     for (const TaurPkg_t& pkg : localPkgs)
         pkgNames.push_back(pkg.name);
 
-    const std::vector<TaurPkg_t>& onlinePkgs = this->fetch_pkgs(pkgNames, useGit);
-
-    int updatedPkgs        = 0;
-    int attemptedDownloads = 0;
+    std::vector<TaurPkg_t> onlinePkgs = this->fetch_pkgs(pkgNames, useGit, failed);
 
-    if (onlinePkgs.size() != localPkgs.size())
+    if (!failed && onlinePkgs.size() != localPkgs.size())
         log_println(WARN,
                     _("Couldn't get all packages! (searched {} packages, got {}) Still trying to update the others."),
                     localPkgs.size(), onlinePkgs.size());
 
-    log_println(INFO, "Here's a list of packages that may be upgraded:");
+    return findUpgradeCandidates(localPkgs, std::move(onlinePkgs));
+}
 
-    std::vector<std::array<TaurPkg_t, 2>> potentialUpgradeTargets;
+/** Match installed AUR packages with their AUR counterpart, and keep the ones that may be upgraded.
+ * Development (-git) packages are always kept, the others only if the AUR has a newer version.
+ * @param localPkgs the installed AUR packages
+ * @param onlinePkgs the same packages on the AUR, in any order, the ones that aren't there anymore are missing
+ * @return the candidates, in the same order as localPkgs
+ */
+std::vector<UpgradeCandidate_t> findUpgradeCandidates(const std::vector<TaurPkg_t>& localPkgs,
+                                                      std::vector<TaurPkg_t>&&      onlinePkgs)
+{
+    std::unordered_map<std::string_view, TaurPkg_t*> onlineByName;
+    onlineByName.reserve(onlinePkgs.size());
+    for (TaurPkg_t& pkg : onlinePkgs)
+        onlineByName.emplace(pkg.name, &pkg);
 
-    for (size_t i = 0; i < onlinePkgs.size(); ++i)
+    std::vector<UpgradeCandidate_t> candidates;
+
+    for (const TaurPkg_t& localPkg : localPkgs)
     {
-        const TaurPkg_t& pkg                    = onlinePkgs[i];
-        const auto&      pkgIteratorInLocalPkgs = std::find_if(
-            localPkgs.begin(), localPkgs.end(), [&pkg](const TaurPkg_t& element) { return element.name == pkg.name; });
+        const auto& it = onlineByName.find(localPkg.name);
+        if (it == onlineByName.end())
+            continue;
 
-        const size_t     pkgIndexInLocalPkgs = std::distance(localPkgs.begin(), pkgIteratorInLocalPkgs);
-        const TaurPkg_t& localPkg            = localPkgs[pkgIndexInLocalPkgs];
+        TaurPkg_t& pkg = *it->second;
+        // the key is a view of pkg.name, drop it before moving pkg
+        onlineByName.erase(it);
 
-        if (hasEnding(pkg.name, "-git"))
-        {
-            potentialUpgradeTargets.push_back({ pkg, localPkg });
-            log_println(INFO, "- {} (from {} to {}, (dev package, may change despite AUR version))", localPkg.name,
-                        localPkg.version, pkg.version);
-            continue;
-        }
+        const bool devel = hasEnding(pkg.name, "-git");
+        if (devel ||
+            ((localPkg.version != pkg.version) && alpm_pkg_vercmp(pkg.version.c_str(), localPkg.version.c_str()) == 1))
+            candidates.push_back({ localPkg, std::move(pkg), devel });
+    }
 
-        if ((localPkg.version != pkg.version) && alpm_pkg_vercmp(pkg.version.c_str(), localPkg.version.c_str()) == 1)
+    return candidates;
+}
+
+/** Format what "taur --check-updates" prints, one "name\tinstalled version\tAUR version" line per outdated package,
+ * or a JSON array of {"name", "installed", "aur"} objects.
+ * Scripts depend on both formats and on the exit code, keep them as they are.
+ * @param candidates what TaurBackend::computeUpgradeCandidates() found, -git packages are only listed if their AUR
+ * version is newer
+ * @param failed whether the AUR couldn't be reached, nothing is printed then
+ * @param json whether to print JSON
+ * @param output set to what to print
+ * @return the exit code: 0 if there are updates, 2 if there are none, 1 if the AUR couldn't be reached
+ */
+int formatUpdates(const std::vector<UpgradeCandidate_t>& candidates, const bool failed, const bool json,
+                  std::string& output)
+{
+    output.clear();
+
+    if (failed)
+        return 1;
+
+    std::vector<const UpgradeCandidate_t*> outdated;
+    for (const UpgradeCandidate_t& candidate : candidates)
+        if (!candidate.devel ||
+            alpm_pkg_vercmp(candidate.online.version.c_str(), candidate.local.version.c_str()) == 1)
+            outdated.push_back(&candidate);
+
+    if (json)
+    {
+        rapidjson::StringBuffer                    buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+        writer.StartArray();
+        for (const UpgradeCandidate_t* candidate : outdated)
         {
-            potentialUpgradeTargets.push_back({ pkg, localPkg });
-            log_println(INFO, "- {} (from {} to {})", localPkg.name, localPkg.version, pkg.version);
-            continue;
+            writer.StartObject();
+            writer.Key("name");
+            writer.String(candidate->local.name.c_str(), candidate->local.name.length());
+            writer.Key("installed");
+            writer.String(candidate->local.version.c_str(), candidate->local.version.length());
+            writer.Key("aur");
+            writer.String(candidate->online.version.c_str(), candidate->online.version.length());
+            writer.EndObject();
         }
+        writer.EndArray();
+
+        output.append(buffer.GetString(), buffer.GetSize());
+        output += '\n';
+    }
+    else
+    {
+        for (const UpgradeCandidate_t* candidate : outdated)
+            output += fmt::format("{}\t{}\t{}\n", candidate->local.name, candidate->local.version,
+                                  candidate->online.version);
+    }
+
+    return outdated.empty() ? 2 : 0;
+}
+
+bool TaurBackend::update_all_aur_pkgs(const path& cacheDir, const bool useGit)
+{
+    const std::vector<TaurPkg_t>& localPkgs = this->get_all_local_pkgs(true);
+
+    if (localPkgs.empty())
+    {
+        log_println(INFO, _("No AUR packages found in your system."));
+        return true;
+    }
+
+    int updatedPkgs        = 0;
+    int attemptedDownloads = 0;
+
+    const std::vector<UpgradeCandidate_t>& potentialUpgradeTargets = this->computeUpgradeCandidates(localPkgs, useGit);
+
+    log_println(INFO, "Here's a list of packages that may be upgraded:");
+
+    for (const UpgradeCandidate_t& potentialUpgrade : potentialUpgradeTargets)
+    {
+        if (potentialUpgrade.devel)
+            log_println(INFO, "- {} (from {} to {}, (dev package, may change despite AUR version))",
+                        potentialUpgrade.local.name, potentialUpgrade.local.version, potentialUpgrade.online.version);
+        else
+            log_println(INFO, "- {} (from {} to {})", potentialUpgrade.local.name, potentialUpgrade.local.version,
+                        potentialUpgrade.online.version);
     }
 
     log_println(INFO, _("{} packages to upgrade."), potentialUpgradeTargets.size());
@@ -512,8 +1268,42 @@ bool TaurBackend::update_all_aur_pkgs(const path& cacheDir, const bool useGit)
     if (!askUserYorN(true, PROMPT_YN_PROCEED_UPGRADE))
         return false;
 
-    for (const auto& potentialUpgrade : potentialUpgradeTargets)
+    std::vector<std::string> urls;
+    std::vector<path>        pkgDirs;
+    urls.reserve(potentialUpgradeTargets.size());
+    pkgDirs.reserve(potentialUpgradeTargets.size());
+
+    for (const UpgradeCandidate_t& potentialUpgrade : potentialUpgradeTargets)
+    {
+        log_println(INFO, _("Downloading {}."), potentialUpgrade.online.name);
+
+        urls.push_back(potentialUpgrade.online.aur_url);
+        pkgDirs.push_back(cacheDir / potentialUpgrade.online.name);
+
+        if (!useGit)
+            std::filesystem::remove_all(pkgDirs.back());
+    }
+
+    const std::vector<bool>& downloaded = this->download_pkgs(urls, pkgDirs);
+
+    // -git packages need their sources to know their real version, fetch them all at once too.
+    std::vector<char> gitSourcesFetched(potentialUpgradeTargets.size(), false);
+
+    run_parallel(potentialUpgradeTargets.size(), config.fetchJobs, [&](const size_t i) {
+        if (!downloaded[i] || !potentialUpgradeTargets[i].devel)
+            return;
+
+        const path& logFile  = config.fetchJobs > 1 ? pkgDirs[i] / BUILD_LOG_NAME : path();
+        gitSourcesFetched[i] = makepkg_exec({ "--verifysource", "-fA" }, false, pkgDirs[i], logFile);
+    });
+
+    std::vector<BuildJob_t> jobs;
+    jobs.reserve(potentialUpgradeTargets.size());
+
+    for (size_t i = 0; i < potentialUpgradeTargets.size(); ++i)
     {
+        const UpgradeCandidate_t& potentialUpgrade = potentialUpgradeTargets[i];
+
         // size_t pkgIndex;
         // bool   found = false;
         bool alrprepared = false;
@@ -525,8 +1315,8 @@ bool TaurBackend::update_all_aur_pkgs(const path& cacheDir, const bool useGit)
         //     }
         // }
 
-        const TaurPkg_t& potentialUpgradeTargetTo   = potentialUpgrade[0];
-        const TaurPkg_t& potentialUpgradeTargetFrom = potentialUpgrade[1];
+        const TaurPkg_t& potentialUpgradeTargetTo   = potentialUpgrade.online;
+        const TaurPkg_t& potentialUpgradeTargetFrom = potentialUpgrade.local;
 
         log_println(DEBUG, "potentialUpgradeTarget.name = {}", potentialUpgradeTargetTo.name);
         log_println(DEBUG, "potentialUpgradeTarget.totaldepends = {}", potentialUpgradeTargetTo.totaldepends);
@@ -536,23 +1326,16 @@ bool TaurBackend::update_all_aur_pkgs(const path& cacheDir, const bool useGit)
         //     onlinePkgs[i].name); continue;
         // }
 
-        const bool isGitPackage = hasEnding(potentialUpgradeTargetTo.name, "-git");
+        const bool isGitPackage = potentialUpgrade.devel;
 
         // if (!isGitPackage && localPkgs[pkgIndex].version == onlinePkgs[i].version) {
         //     log_println(DEBUG, "pkg {} has no update, local: {}, online: {}, skipping!", localPkgs[pkgIndex].name,
         //     localPkgs[pkgIndex].version, onlinePkgs[i].version); continue;
         // }
 
-        const path& pkgDir = cacheDir / potentialUpgradeTargetTo.name;
-
-        log_println(INFO, _("Downloading {}."), potentialUpgradeTargetTo.name);
-
-        if (!useGit)
-            std::filesystem::remove_all(pkgDir);
-
-        bool downloadSuccess = this->download_pkg(potentialUpgradeTargetTo.aur_url, pkgDir);
+        const path& pkgDir = pkgDirs[i];
 
-        if (!downloadSuccess)
+        if (!downloaded[i])
         {
             log_println(WARN, _("Failed to download package {}!"), potentialUpgradeTargetTo.name);
             continue;
@@ -562,28 +1345,19 @@ bool TaurBackend::update_all_aur_pkgs(const path& cacheDir, const bool useGit)
         if (isGitPackage)
         {
             alrprepared = true;
-            std::filesystem::current_path(pkgDir);
-            if (makepkg_exec({ "--verifysource", "-fA" }))
-                taur_exec({ config.git.c_str(), "-C", pkgDir, "reset", "--hard", "HEAD" }) &&
-                    makepkg_exec({ "--nobuild", "-dfA" });
-        }
-
-        u_short       iter_index = 0;
-        std::ifstream pkgbuild(pkgDir.string() + "/PKGBUILD", std::ios::in);
-        std::string   versionInfo, pkgrel, epoch;
-        while (std::getline(pkgbuild, line) && iter_index < 3)
-        {
-            if (hasStart(line, "pkgver="))
-                getFileValue(iter_index, line, versionInfo, "pkgver="_len);
-
-            else if (hasStart(line, "pkgrel="))
-                getFileValue(iter_index, line, pkgrel, "pkgrel"_len);
+            if (!gitSourcesFetched[i])
+            {
+                log_println(WARN, _("Failed to fetch the sources of {}!"), potentialUpgradeTargetTo.name);
+                continue;
+            }
 
-            else if (hasStart(line, "epoch="))
-                getFileValue(iter_index, line, epoch, "epoch="_len);
+            taur_exec({ config.git.c_str(), "-C", pkgDir, "reset", "--hard", "HEAD" }) &&
+                makepkg_exec({ "--nobuild", "-dfA" }, true, pkgDir);
         }
 
-        if (versionInfo.empty())
+        // for -git packages, that's the version pkgver() just wrote in the PKGBUILD
+        const std::optional<Srcinfo_t>& srcinfo = get_srcinfo(pkgDir);
+        if (!srcinfo || srcinfo->get("pkgver").empty())
         {
             log_println(
                 WARN,
@@ -592,11 +1366,7 @@ bool TaurBackend::update_all_aur_pkgs(const path& cacheDir, const bool useGit)
             continue;
         }
 
-        if (!pkgrel.empty() && pkgrel[0] != '\0')
-            versionInfo += '-' + pkgrel;
-
-        if (!epoch.empty() && epoch[0] != '\0')
-            versionInfo = epoch + ':' + versionInfo;
+        const std::string& versionInfo = srcinfo->version();
 
         log_println(DEBUG, "pkg {} versions: local {} vs online {}", potentialUpgradeTargetTo.name,
                     potentialUpgradeTargetTo.version, potentialUpgradeTargetFrom.version);
@@ -615,32 +1385,34 @@ bool TaurBackend::update_all_aur_pkgs(const path& cacheDir, const bool useGit)
                     potentialUpgradeTargetFrom.version, potentialUpgradeTargetTo.version);
         attemptedDownloads++;
 
-        this->handle_aur_depends(potentialUpgradeTargetTo, pkgDir, this->get_all_local_pkgs(true), useGit);
-        bool installSuccess = this->build_pkg(potentialUpgradeTargetTo.name, pkgDir.string(), alrprepared);
+        jobs.push_back({ potentialUpgradeTargetTo, pkgDir, alrprepared });
+    }
 
-        if (installSuccess)
-        {
-            pkgs_to_install += built_pkg + ' ';
-            log_println(DEBUG, "pkgs_to_install = {}", pkgs_to_install);
-            updatedPkgs++;
+    if (!jobs.empty() && !this->handle_aur_depends(jobs, cacheDir, localPkgs, useGit))
+        log_println(ERROR, _("Installing AUR dependencies for your package has failed."));
 
-            // prevent duplicated entries
-            // localPkgs.erase(localPkgs.begin() + pkgIndex);
-        }
-        else
-        {
-            pkgs_failed_to_build.push_back(potentialUpgradeTargetTo.name);
-            log_println(DEBUG, "pkgs_failed_to_build = {}", pkgs_failed_to_build);
-        }
+    std::vector<BuildResult_t>                 toInstall;
+    const std::vector<std::string>&            failed = this->build_pkgs(jobs, toInstall);
+    const std::unordered_set<std::string_view> failedNames(failed.begin(), failed.end());
+
+    updatedPkgs = attemptedDownloads;
+    for (const UpgradeCandidate_t& potentialUpgrade : potentialUpgradeTargets)
+    {
+        if (!failedNames.contains(potentialUpgrade.online.name))
+            continue;
+
+        updatedPkgs--;
+        pkgs_failed_to_build.push_back(potentialUpgrade.online.name);
+        log_println(DEBUG, "pkgs_failed_to_build = {}", pkgs_failed_to_build);
     }
 
-    if (pkgs_to_install.size() <= 0)
+    if (toInstall.empty())
     {
         log_println(WARN, _("No packages to be upgraded."));
         return false;
     }
 
-    if (!pacman_exec("-U", split(pkgs_to_install, ' '), false))
+    if (!install_builds(toInstall))
     {
         log_println(ERROR, _("Failed to install/upgrade packages"));
         return false;
@@ -661,90 +1433,215 @@ bool TaurBackend::update_all_aur_pkgs(const path& cacheDir, const bool useGit)
     return true;
 }
 
-// all AUR local packages
-// returns a barebones TaurPkg_t structure, with no description/depends list
-std::vector<TaurPkg_t> TaurBackend::get_all_local_pkgs(const bool aurOnly)
+static TaurPkg_t makeLocalPkg(const std::string_view name, const std::string_view version)
 {
-    std::vector<alpm_pkg_t*> pkgs;
-
-    alpm_list_t* syncdbs = config.repos;
+    return { .name      = std::string(name),
+             .version   = std::string(version),
+             .aur_url   = "https://aur.archlinux.org/" + cpr::util::urlEncode(std::string(name)) + ".git",
+             .installed = true };
+}
 
-    for (alpm_list_t* pkg = alpm_db_get_pkgcache(alpm_get_localdb(config.handle)); pkg; pkg = pkg->next)
-        pkgs.push_back(reinterpret_cast<alpm_pkg_t*>(pkg->data));
+/** Read the installed AUR packages cached in cacheDir/.foreign-pkgs, see getForeignPkgs().
+ * @param key what get_db_state() returns now
+ * @return the packages, or nothing if they aren't cached, or were cached under another key
+ */
+std::optional<std::vector<TaurPkg_t>> readForeignPkgsCache(const std::string_view key)
+{
+    std::ifstream file(config->cacheDir / ".foreign-pkgs");
 
-    if (aurOnly)
-        pkgs = filterAURPkgs(pkgs, syncdbs, true);
+    std::string fileKey, name, version;
+    if (!std::getline(file, fileKey) || fileKey != key)
+        return {};
 
+    // one "name version" per line
     std::vector<TaurPkg_t> out;
-    out.reserve(pkgs.size());
+    while (file >> name >> version)
+        out.push_back(makeLocalPkg(name, version));
+
+    return out;
+}
 
-    for (alpm_pkg_t* pkg : pkgs)
+/** Cache the installed AUR packages in cacheDir/.foreign-pkgs, see getForeignPkgs().
+ * Nothing is written in read-only runs, nor if key isn't what libalpm read when taur started: if the dbs changed since
+ * (e.g pacman -Syu ran meanwhile), the packages were found in older data than the key says.
+ * @param key what get_db_state() returns now
+ * @param pkgs the installed AUR packages
+ * @return whether they got written
+ */
+bool writeForeignPkgsCache(const std::string_view key, const std::vector<TaurPkg_t>& pkgs)
+{
+    if (config->readOnly || key != config->dbStateAtLoad)
+        return false;
+
+    // write it somewhere else first, so other taur processes never read a half written file.
+    const path&   file_path = config->cacheDir / ".foreign-pkgs";
+    const path&   tmp_path  = fmt::format("{}.{}", file_path.string(), getpid());
+    std::ofstream tmp_file(tmp_path, std::ios::trunc);
+
+    tmp_file << key << '\n';
+    for (const TaurPkg_t& pkg : pkgs)
+        tmp_file << pkg.name << ' ' << pkg.version << '\n';
+    tmp_file.close();
+
+    std::error_code ec;
+    if (tmp_file)
+        std::filesystem::rename(tmp_path, file_path, ec);
+    else
+        std::filesystem::remove(tmp_path, ec);
+
+    return tmp_file && !ec;
+}
+
+/** Get the installed AUR packages, the ones that aren't in any sync db.
+ * Finding them means loading every sync db, so they're cached in cacheDir/.foreign-pkgs with get_db_state() as key,
+ * and in memory, and only found again once the key changes.
+ */
+static std::vector<TaurPkg_t> getForeignPkgs()
+{
+    static std::string            cachedKey;
+    static std::vector<TaurPkg_t> cached;
+
+    const std::string& key = get_db_state(config->handle, config->repos);
+    if (key == cachedKey)
+        return cached;
+
+    std::optional<std::vector<TaurPkg_t>> out = readForeignPkgsCache(key);
+    if (!out)
     {
-        out.push_back({ .name    = alpm_pkg_get_name(pkg),
-                        .version = alpm_pkg_get_version(pkg),
-                        .aur_url = "https://aur.archlinux.org/" + cpr::util::urlEncode(alpm_pkg_get_name(pkg)) + ".git",
-                        .installed = true });
+        out.emplace();
+
+        std::vector<alpm_pkg_t*> pkgs;
+        for (alpm_list_t* pkg = alpm_db_get_pkgcache(alpm_get_localdb(config->handle)); pkg; pkg = pkg->next)
+            pkgs.push_back(reinterpret_cast<alpm_pkg_t*>(pkg->data));
+
+        for (alpm_pkg_t* pkg : filterAURPkgs(pkgs, config->repos, true))
+            out->push_back(makeLocalPkg(alpm_pkg_get_name(pkg), alpm_pkg_get_version(pkg)));
+
+        writeForeignPkgsCache(key, *out);
     }
 
-    return out;
+    cachedKey = key;
+    cached    = *out;
+
+    return std::move(*out);
 }
 
-// They are different because we found that fetching each AUR pkg is very time consuming, so we store the name and look
-// it up later.
-std::vector<TaurPkg_t> TaurBackend::getPkgFromJson(const rapidjson::Document& doc, const bool useGit)
+// all AUR local packages
+// returns a barebones TaurPkg_t structure, with no description/depends list
+std::vector<TaurPkg_t> TaurBackend::get_all_local_pkgs(const bool aurOnly)
 {
-    int resultcount = doc["resultcount"].GetInt();
+    if (aurOnly)
+        return getForeignPkgs();
 
-    std::vector<TaurPkg_t> out(resultcount);
+    std::vector<TaurPkg_t> out;
 
-    for (int i = 0; i < resultcount; ++i)
-        out[i] = parsePkg(doc["results"][i], useGit);
+    for (alpm_list_t* i = alpm_db_get_pkgcache(alpm_get_localdb(config.handle)); i; i = i->next)
+    {
+        alpm_pkg_t* pkg = reinterpret_cast<alpm_pkg_t*>(i->data);
+        out.push_back(makeLocalPkg(alpm_pkg_get_name(pkg), alpm_pkg_get_version(pkg)));
+    }
 
     return out;
 }
 
+// They are different because we found that fetching each AUR pkg is very time consuming, so we store the name and look
+// it up later.
 std::vector<TaurPkg_t> TaurBackend::search_pac(const std::string_view query)
 {
     // we search for the package name and print only the name, not the description
-    alpm_list_t* syncdbs = config.repos;
-    alpm_db_t*   localdb = alpm_get_localdb(config.handle);
+    alpm_db_t* localdb = alpm_get_localdb(config.handle);
 
-    alpm_list_smart_pointer packages(nullptr, alpm_list_free);
-    alpm_list_smart_pointer query_regex(alpm_list_add(nullptr, (void*)query.data()), alpm_list_free);
+    alpm_list_smart_pointer   query_regex(alpm_list_add(nullptr, (void*)query.data()), alpm_list_free);
+    std::vector<alpm_list_t*> results;
 
-    for (; syncdbs; syncdbs = alpm_list_next(syncdbs))
+    // one db after another, every libalpm call writes the handle's error code, so they can't run in many threads
+    for (alpm_list_t* syncdb = config.repos; syncdb; syncdb = alpm_list_next(syncdb))
     {
-        alpm_list_t* ret = nullptr;
-        if (alpm_db_search((alpm_db_t*)(syncdbs->data), query_regex.get(), &ret) == 0)
-        {
-            for (alpm_list_t* retClone = ret; retClone; retClone = retClone->next)
-            {
-                alpm_list_t* packages_get = packages.get();
-                (void)packages.release();
-                packages =
-                    make_list_smart_pointer(alpm_list_add(packages_get, reinterpret_cast<alpm_pkg_t*>(retClone->data)));
-            }
-        }
+        alpm_list_t* result = nullptr;
+        if (alpm_db_search(reinterpret_cast<alpm_db_t*>(syncdb->data), query_regex.get(), &result) == 0)
+            results.push_back(result);
     }
 
+    size_t total = 0;
+    for (alpm_list_t* result : results)
+        total += alpm_list_count(result);
+
     std::vector<TaurPkg_t> out;
+    out.reserve(total);
 
-    for (alpm_list_t* packages_get = packages.get(); packages_get; packages_get = packages_get->next)
+    for (alpm_list_t* result : results)
     {
-        alpm_pkg_t* pkg = reinterpret_cast<alpm_pkg_t*>(packages_get->data);
+        for (alpm_list_t* packages_get = result; packages_get; packages_get = packages_get->next)
+        {
+            alpm_pkg_t* pkg = reinterpret_cast<alpm_pkg_t*>(packages_get->data);
+
+            out.push_back({ .name          = alpm_pkg_get_name(pkg),
+                            .version       = alpm_pkg_get_version(pkg),
+                            .desc          = alpm_pkg_get_desc(pkg),
+                            .last_modified = alpm_pkg_get_builddate(pkg),
+                            .votes         = -1,
+                            .installed     = alpm_db_get_pkg(localdb, alpm_pkg_get_name(pkg)) != nullptr,
+                            .db_name       = alpm_db_get_name(alpm_pkg_get_db(pkg)) });
+        }
 
-        out.push_back({ .name          = alpm_pkg_get_name(pkg),
-                        .version       = alpm_pkg_get_version(pkg),
-                        .desc          = alpm_pkg_get_desc(pkg),
-                        .last_modified = alpm_pkg_get_builddate(pkg),
-                        .votes         = -1,
-                        .installed     = alpm_db_get_pkg(localdb, alpm_pkg_get_name(pkg)) != nullptr,
-                        .db_name       = alpm_db_get_name(alpm_pkg_get_db(pkg)) });
+        alpm_list_free(result);
     }
 
     return out;
 }
 
+/** Search the AUR through the RPC, the responses are cached for rpcCacheTTL seconds.
+ * @param query what to search for
+ * @param searchBy the field to search, as in the RPC's "by" argument
+ * @param useGit whether the packages should use a .git url
+ * @return the packages found, or nothing if the AUR couldn't be reached and nothing was cached.
+ * TaurPkg_t::installed is left for the caller to fill.
+ */
+std::optional<std::vector<TaurPkg_t>> TaurBackend::search_rpc(const std::string_view query,
+                                                              const std::string_view searchBy, const bool useGit)
+{
+    const std::string& queryStr = cpr::util::urlEncode(query.data());
+
+    // link to AUR API. Took search pattern from yay
+    const cpr::Url& url =
+        fmt::format("https://aur.archlinux.org/rpc?arg%5B%5D={}&by={}&type=search&v=5", queryStr, searchBy);
+    log_println(DEBUG, "url search = {}", url.str());
+
+    // keep the file name under the usual 255 bytes limit, long queries just don't get cached.
+    const path& cachePath = config.cacheDir / ".rpc" / "search" / fmt::format("{}-{}.json", searchBy, queryStr);
+    const bool  cacheable = config.rpcCacheTTL > 0 && cachePath.filename().string().length() < 255;
+
+    RpcHandler cached(useGit, true, false), fetched(useGit, false, false);
+    bool       hasCache = cacheable && readRpcCache(cachePath, cached);
+
+    if (!hasCache || !isRpcCacheFresh(cached))
+    {
+        const cpr::Response r = this->http_get(url.str());
+
+        if (r.status_code == 200 && parseRpcString(r.text, fetched))
+        {
+            hasCache = false;
+            // errors like "Too many package results." shouldn't stick around
+            if (cacheable && fetched.type != "error")
+                writeRpcCache(cachePath, r.text);
+        }
+        else if (hasCache)
+            log_println(DEBUG, "AUR search failed, using the cached results for {}", query);
+        else
+        {
+            log_println(ERROR, "AUR Search error: {}", r.status_code);
+            return {};
+        }
+    }
+
+    RpcHandler& json_response = hasCache ? cached : fetched;
+
+    if (json_response.type == "error")
+        log_println(ERROR, "AUR Search error: {}", json_response.error);
+
+    return std::move(json_response.pkgs);
+}
+
 // Returns an optional that is empty if an error occurs
 // status will be set to -1 in the case of an error as well.
 std::vector<TaurPkg_t> TaurBackend::search(const std::string_view query, const bool useGit, const bool aurOnly,
@@ -753,44 +1650,51 @@ std::vector<TaurPkg_t> TaurBackend::search(const std::string_view query, const b
     if (query.empty())
         return {};
 
-    // link to AUR API. Took search pattern from yay
-    const cpr::Url& url =
-        fmt::format("https://aur.archlinux.org/rpc?arg%5B%5D={}&by={}&type=search&v=5",
-                    cpr::util::urlEncode(query.data()), config.getConfigValue<std::string>("searchBy", "name-desc"));
-    log_println(DEBUG, "url search = {}", url.str());
+    const std::string& searchBy = config.getConfigValue<std::string>("searchBy", "name-desc");
 
-    const cpr::Response    r                 = cpr::Get(url);
-    const std::string_view raw_text_response = r.text;
+    // loaded here and not in the thread below, as it may download and rebuild the store, and isn't thread safe.
+    const AurMetadata* metadata = config.localMetadata ? load_aur_metadata() : nullptr;
 
-    rapidjson::Document json_response;
-    json_response.Parse(raw_text_response.data());
+    // search the AUR in another thread while the sync dbs are searched in this one, libalpm isn't thread safe.
+    std::future<std::optional<std::vector<TaurPkg_t>>> aurSearch = std::async(std::launch::async, [&, metadata]() {
+        std::optional<std::vector<TaurPkg_t>> found;
 
-    // clang-format off
-    const std::vector<TaurPkg_t>& aurPkgs = (json_response["resultcount"].GetInt64() > 0) ? 
-                                            this->getPkgFromJson(json_response, useGit) : std::vector<TaurPkg_t>();
+        if (metadata)
+            found = metadata->search(query, searchBy, useGit);
 
-    const std::vector<TaurPkg_t>& pacPkgs = (!aurOnly) ? this->search_pac(query)        : std::vector<TaurPkg_t>();
+        if (!found && config.localMetadata)
+            log_println(DEBUG, "Couldn't search by {} in the local AUR metadata, asking the AUR", searchBy);
 
-    if (std::string_view(json_response["type"].GetString(), json_response["type"].GetStringLength()) == "error")
-        log_println(ERROR, "AUR Search error: {}", json_response["error"].GetString());
+        return found ? std::move(found) : this->search_rpc(query, searchBy, useGit);
+    });
 
-    const size_t& allPkgsSize = aurPkgs.size() + pacPkgs.size();
+    std::vector<TaurPkg_t> pacPkgs = (!aurOnly) ? this->search_pac(query) : std::vector<TaurPkg_t>();
 
-    std::vector<TaurPkg_t> combined;
+    std::optional<std::vector<TaurPkg_t>> found = aurSearch.get();
+    if (!found)
+        return pacPkgs;
 
-    combined.reserve(allPkgsSize);
+    std::vector<TaurPkg_t>& aurPkgs = *found;
+    setInstalled(aurPkgs);
 
-    if (!aurPkgs.empty())
-        combined.insert(combined.end(), aurPkgs.begin(), aurPkgs.end());
-    if (!pacPkgs.empty())
-        combined.insert(combined.end(), pacPkgs.begin(), pacPkgs.end());
+    // move everything instead of copying, broad searches can return thousands of packages.
+    std::vector<TaurPkg_t> combined = std::move(aurPkgs);
+    combined.reserve(combined.size() + pacPkgs.size());
+    std::move(pacPkgs.begin(), pacPkgs.end(), std::back_inserter(combined));
 
     if (!checkExactMatch)  // caller doesn't want us to check for an exact match.
         return combined;
 
     for (size_t i = 0; i < combined.size(); ++i)
+    {
         if (combined[i].name == query)
-            return { combined[i] };  // return the exact match only.
+        {
+            // return the exact match only.
+            std::vector<TaurPkg_t> exactMatch;
+            exactMatch.push_back(std::move(combined[i]));
+            return exactMatch;
+        }
+    }
 
     return combined;
 }
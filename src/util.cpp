@@ -7,8 +7,18 @@
  */
 
 #include <alpm.h>
+#include <fcntl.h>
+#include <openssl/evp.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
 
 #include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <unordered_set>
 #pragma GCC diagnostic ignored "-Wignored-attributes"
 
 #include "config.hpp"
@@ -140,6 +150,67 @@ void interruptHandler(int)
 { die(_("Caught CTRL-C, Exiting!")); }
 
 // clang-format on
+/** Get the names of every package in the sync databases, to tell quickly whether a package comes from them.
+ * It's built the first time and kept for the rest of the run, unless it's asked about other databases.
+ * @param syncdbs the sync databases
+ * @return the names, they point into libalpm's package cache
+ */
+static const std::unordered_set<std::string_view>& get_sync_pkg_names(alpm_list_t* syncdbs)
+{
+    static std::vector<alpm_db_t*>              cachedDbs;
+    static std::unordered_set<std::string_view> names;
+    static bool                                 built = false;
+
+    std::vector<alpm_db_t*> dbs;
+    for (; syncdbs; syncdbs = alpm_list_next(syncdbs))
+        dbs.push_back(reinterpret_cast<alpm_db_t*>(syncdbs->data));
+
+    if (built && dbs == cachedDbs)
+        return names;
+
+    size_t total = 0;
+    for (alpm_db_t* db : dbs)
+        total += alpm_list_count(alpm_db_get_pkgcache(db));
+
+    names.clear();
+    names.reserve(total);
+
+    for (alpm_db_t* db : dbs)
+        for (alpm_list_t* pkg = alpm_db_get_pkgcache(db); pkg; pkg = pkg->next)
+            names.insert(alpm_pkg_get_name(reinterpret_cast<alpm_pkg_t*>(pkg->data)));
+
+    cachedDbs = std::move(dbs);
+    built     = true;
+
+    return names;
+}
+
+/** Describe the state of the local and sync dbs on disk, e.g to know whether what was read from them is still right.
+ * Installing, upgrading or removing a package changes the mtime of the local db folder, and syncing a db changes the
+ * mtime of its file.
+ * @param handle the handle the dbs are registered in
+ * @param syncdbs the sync dbs
+ */
+std::string get_db_state(alpm_handle_t* handle, alpm_list_t* syncdbs)
+{
+    const path& dbPath = alpm_option_get_dbpath(handle);
+
+    std::error_code ec;
+    const auto&     getMtime = [&](const path& file_path) {
+        const auto& mtime = std::filesystem::last_write_time(file_path, ec);
+        return ec ? -1 : mtime.time_since_epoch().count();
+    };
+
+    std::string key = fmt::format("local={}", getMtime(dbPath / "local"));
+    for (alpm_list_t* syncdb = syncdbs; syncdb; syncdb = alpm_list_next(syncdb))
+    {
+        const char* name = alpm_db_get_name(reinterpret_cast<alpm_db_t*>(syncdb->data));
+        key += fmt::format(" {}={}", name, getMtime(dbPath / "sync" / fmt::format("{}.db", name)));
+    }
+
+    return key;
+}
+
 /** Function to check if a package is from a synchronization database
  * Basically if it's in pacman repos like core, extra, multilib, etc.
  * @param name The package name to check
@@ -147,13 +218,7 @@ void interruptHandler(int)
  * @return true if the pkg exists, else false
  */
 bool is_package_from_syncdb(const char* name, alpm_list_t* syncdbs)
-{
-    for (; syncdbs; syncdbs = alpm_list_next(syncdbs))
-        if (alpm_db_get_pkg((alpm_db_t*)(syncdbs->data), name))
-            return true;
-
-    return false;
-}
+{ return get_sync_pkg_names(syncdbs).contains(name); }
 
 // soft means it won't return false (or even try) if the list is empty
 bool commitTransactionAndRelease(const bool soft)
@@ -374,20 +439,15 @@ fmt::rgb hexStringToColor(std::string_view hexstr)
     return fmt::rgb(red, green, blue);
 }
 
-// http://stackoverflow.com/questions/478898/ddg#478960
+/** Run a command line with sh and get what it prints.
+ * @param cmd the command line
+ * @return its stdout, without the last newline
+ */
 std::string shell_exec(const std::string_view cmd)
 {
-    std::array<char, 1024>                   buffer;
-    std::string                              result;
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(cmd.data(), "r"), pclose);
+    const std::string cmd_str(cmd);
+    std::string       result = capture_exec({ "sh", "-c", cmd_str.c_str() }).out;
 
-    if (!pipe)
-        die(_("popen() failed!"));
-
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr)
-        result += buffer.data();
-
-    // why there is a '\n' at the end??
     if (!result.empty() && result.back() == '\n')
         result.pop_back();
     return result;
@@ -404,125 +464,266 @@ bool is_numerical(const std::string_view s, const bool allowSpace)
                std::find_if(s.begin(), s.end(), [](unsigned char c) { return (!std::isdigit(c)); }) == s.end();
 }
 
-bool taur_read_exec(std::vector<const char*> cmd, std::string& output, const bool exitOnFailure)
+/** Start a command with posix_spawn(), which doesn't copy taur's memory like fork() would.
+ * Its working directory and environment are given to it directly, taur's own are never changed,
+ * so commands can be started from many threads at once.
+ * @param cmd the command and its arguments, the command is looked up in $PATH
+ * @param options where it runs and what's added to its environment
+ * @param actions the redirections of its stdin, stdout and stderr
+ * @param attrs its process group and such, nullptr for the defaults
+ * @return its pid, or -1 if it couldn't be started
+ */
+static pid_t spawn_process(std::vector<const char*> cmd, const ExecOptions_t& options,
+                           posix_spawn_file_actions_t& actions, const posix_spawnattr_t* attrs = nullptr)
 {
-    int pipeout[2];
+    if (!options.cwd.empty())
+        posix_spawn_file_actions_addchdir_np(&actions, options.cwd.c_str());
+
+    // taur's environment, without what options.env replaces
+    std::vector<const char*> envp;
+    if (!options.env.empty())
+    {
+        for (char** var = environ; *var; ++var)
+        {
+            const std::string_view name = std::string_view(*var).substr(0, std::string_view(*var).find('='));
+            if (std::none_of(options.env.begin(), options.env.end(), [name](const std::string& replacement) {
+                    return hasStart(replacement, name) && replacement.length() > name.length() &&
+                           replacement[name.length()] == '=';
+                }))
+                envp.push_back(*var);
+        }
+
+        for (const std::string& var : options.env)
+            envp.push_back(var.c_str());
+        envp.push_back(nullptr);
+    }
+
+    cmd.push_back(nullptr);
+
+    pid_t     pid;
+    const int err = posix_spawnp(&pid, cmd[0], &actions, attrs, const_cast<char* const*>(cmd.data()),
+                                 options.env.empty() ? environ : const_cast<char* const*>(envp.data()));
+    if (err != 0)
+    {
+        log_println(ERROR, _("Failed to run {}: {}"), cmd[0], strerror(err));
+        return -1;
+    }
+
+    return pid;
+}
 
-    if (pipe(pipeout) < 0)
+/** Run a command and read everything it prints, stdout and stderr at the same time,
+ * so it never blocks on a full pipe, however much it prints.
+ * @param cmd the command and its arguments
+ * @param timeout kill it if it runs longer than this, 0 to wait as long as it takes
+ * @param options where it runs and what's added to its environment
+ * @return what it printed and how it ended
+ */
+ExecResult_t capture_exec(std::vector<const char*> cmd, const std::chrono::milliseconds timeout,
+                          const ExecOptions_t& options)
+{
+    ExecResult_t result;
+
+    log_println(DEBUG, "capturing {}", cmd);
+
+    // close-on-exec, so the commands other threads start at the same time don't keep them open
+    int pipeout[2], pipeerr[2];
+    if (pipe2(pipeout, O_CLOEXEC) < 0)
+        die(_("pipe() failed: {}"), strerror(errno));
+    if (pipe2(pipeerr, O_CLOEXEC) < 0)
         die(_("pipe() failed: {}"), strerror(errno));
 
-    int pid = fork();
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, pipeout[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, pipeerr[1], STDERR_FILENO);
 
-    if (pid > 0)
-    {  // we wait for the command to finish then start executing the rest
-        close(pipeout[1]);
+    // its own process group, so a timeout kills whatever it started too, not just the command itself
+    posix_spawnattr_t attrs;
+    posix_spawnattr_init(&attrs);
+    posix_spawnattr_setflags(&attrs, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attrs, 0);
 
-        int status;
-        waitpid(pid, &status, 0);  // Wait for the child to finish
+    const pid_t pid = spawn_process(cmd, options, actions, &attrs);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attrs);
 
-        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    close(pipeout[1]);
+    close(pipeerr[1]);
+
+    if (pid < 0)
+    {
+        close(pipeout[0]);
+        close(pipeerr[0]);
+        return result;
+    }
+
+    std::array<pollfd, 2>       fds     = { { { pipeout[0], POLLIN, 0 }, { pipeerr[0], POLLIN, 0 } } };
+    std::array<std::string*, 2> outputs = { &result.out, &result.err };
+    std::array<char, 65536>     buffer;
+
+    const auto& deadline = std::chrono::steady_clock::now() + timeout;
+
+    // a fd is set to -1 once it's closed, poll() skips those
+    while (fds[0].fd >= 0 || fds[1].fd >= 0)
+    {
+        int waitMs = -1;
+        if (timeout.count() > 0)
         {
-            // read stdout
-            char c;
-            while (read(pipeout[0], &c, 1) == 1)
+            const auto& left =
+                std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0)
             {
-                output += c;
+                log_println(WARN, _("{} took longer than {}s, killing it"), cmd[0], timeout.count() / 1000.0);
+                kill(-pid, SIGKILL);
+                result.timedOut = true;
+                break;
             }
+            waitMs = left.count();
+        }
 
-            close(pipeout[0]);
-
-            return true;
+        if (poll(fds.data(), fds.size(), waitMs) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            die(_("poll() failed: {}"), strerror(errno));
         }
-        else
+
+        for (size_t i = 0; i < fds.size(); ++i)
         {
-            log_println(ERROR, _("Failed to execute the command: {}"), fmt::join(cmd, " "));
-            if (exitOnFailure)
-                exit(-1);
+            if (fds[i].fd < 0 || fds[i].revents == 0)
+                continue;
+
+            const ssize_t n = read(fds[i].fd, buffer.data(), buffer.size());
+            if (n > 0)
+                outputs[i]->append(buffer.data(), n);
+            else if (n == 0 || errno != EINTR)
+            {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+            }
         }
     }
-    else if (pid == 0)
-    {
-        if (dup2(pipeout[1], STDOUT_FILENO) == -1)
-            exit(1);
 
-        close(pipeout[0]);
-        close(pipeout[1]);
-        cmd.push_back(nullptr);
-        execvp(cmd[0], const_cast<char* const*>(cmd.data()));
+    for (const pollfd& fd : fds)
+        if (fd.fd >= 0)
+            close(fd.fd);
 
-        die(_("An error has occurred: {}"), strerror(errno));
+    int status;
+    while (wait4(pid, &status, 0, &result.usage) < 0)
+    {
+        if (errno != EINTR)
+            die(_("wait4() failed: {}"), strerror(errno));
     }
-    else
+
+    if (WIFEXITED(status) && !result.timedOut)
+        result.exitCode = WEXITSTATUS(status);
+
+    const double cpuTime = result.usage.ru_utime.tv_sec + result.usage.ru_stime.tv_sec +
+                           (result.usage.ru_utime.tv_usec + result.usage.ru_stime.tv_usec) / 1e6;
+    log_println(DEBUG, "{} exited with {}, took {:.3f}s of CPU and {} KiB of memory", cmd[0], result.exitCode, cpuTime,
+                result.usage.ru_maxrss);
+
+    return result;
+}
+
+/** Run a command and get what it prints, see capture_exec().
+ * @param cmd the command and its arguments
+ * @param output what the command printed on stdout gets appended to it, if it succeeded
+ * @param exitOnFailure Whether to call exit(-1) on command failure.
+ * @param timeout kill it if it runs longer than this, 0 to wait as long as it takes
+ * @param options where it runs and what's added to its environment
+ * @return true if the command successed, else false
+ */
+bool taur_read_exec(std::vector<const char*> cmd, std::string& output, const bool exitOnFailure,
+                    const std::chrono::milliseconds timeout, const ExecOptions_t& options)
+{
+    const ExecResult_t& result = capture_exec(cmd, timeout, options);
+
+    if (result.success())
     {
-        close(pipeout[0]);
-        close(pipeout[1]);
-        die(_("fork() failed: {}"), strerror(errno));
+        output += result.out;
+        return true;
     }
 
-    close(pipeout[0]);
-    close(pipeout[1]);
+    // it's not shown while it runs, so show it now
+    if (!result.err.empty())
+        fmt::print(stderr, "{}", result.err);
+
+    log_println(ERROR, _("Failed to execute the command: {}"), fmt::join(cmd, " "));
+    if (exitOnFailure)
+        exit(-1);
 
     return false;
 }
 
-/** Executes commands with execvp() and keep the program running without existing
+/** Executes commands with posix_spawn() and keep the program running without existing
  * @param cmd_str The command to execute
  * @param exitOnFailure Whether to call exit(1) on command failure.
+ * @param options Where the command runs and what's added to its environment
+ * @param logFile If not empty, the command's stdout and stderr get appended to this file instead of the terminal
  * @return true if the command successed, else false
  */
-bool taur_exec(const std::vector<std::string> cmd_str, const bool exitOnFailure)
+bool taur_exec(const std::vector<std::string> cmd_str, const bool exitOnFailure, const ExecOptions_t& options,
+               const path& logFile)
 {
     std::vector<const char*> cmd;
     for (const std::string_view str : cmd_str)
         cmd.push_back(str.data());
 
-    int pid = fork();
+    log_println(DEBUG, "running {}", cmd);
 
-    if (pid < 0)
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+
+    if (!logFile.empty())
     {
-        die(_("fork() failed: {}"), strerror(errno));
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, logFile.c_str(), O_WRONLY | O_CREAT | O_APPEND,
+                                         0644);
+        posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
     }
 
-    if (pid == 0)
-    {
-        log_println(DEBUG, "running {}", cmd);
-        cmd.push_back(nullptr);
-        execvp(cmd[0], const_cast<char* const*>(cmd.data()));
+    const pid_t pid = spawn_process(cmd, options, actions);
+    posix_spawn_file_actions_destroy(&actions);
 
-        // execvp() returns instead of exiting when failed
-        die(_("An error has occurred: {}: {}"), cmd[0], strerror(errno));
-    }
-    else if (pid > 0)
+    if (pid > 0)
     {  // we wait for the command to finish then start executing the rest
         int status;
-        waitpid(pid, &status, 0);  // Wait for the child to finish
+        while (waitpid(pid, &status, 0) < 0)
+        {
+            if (errno != EINTR)
+                die(_("waitpid() failed: {}"), strerror(errno));
+        }
 
         if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
             return true;
-        else
-        {
-            log_println(ERROR, _("Failed to execute the command: {}"), fmt::join(cmd, " "));
-            if (exitOnFailure)
-                exit(1);
-        }
     }
 
+    log_println(ERROR, _("Failed to execute the command: {}"), fmt::join(cmd, " "));
+    if (exitOnFailure)
+        exit(1);
+
     return false;
 }
 
 /** Convinient way to executes makepkg commands with taur_exec() and keep the program running without existing
  * @param cmd The command to execute
  * @param exitOnFailure Whether to call exit(1) on command failure.
+ * @param cwd The directory to run makepkg in, empty for the current one
+ * @param logFile If not empty, where makepkg's output goes instead of the terminal
  * @return true if the command successed, else false
  */
-bool makepkg_exec(std::vector<std::string> const& args, const bool exitOnFailure)
+bool makepkg_exec(std::vector<std::string> const& args, const bool exitOnFailure, const path& cwd,
+                  const path& logFile)
 {
     std::vector<std::string> cmd{ config->makepkgBin };
 
     if (config->noconfirm)
         cmd.push_back("--noconfirm");
 
-    if (!config->colors)
+    if (!config->colors || !logFile.empty())
         cmd.push_back("--nocolor");
 
     cmd.push_back("--config");
@@ -531,7 +732,7 @@ bool makepkg_exec(std::vector<std::string> const& args, const bool exitOnFailure
     for (auto& str : args)
         cmd.push_back(str.c_str());
 
-    return taur_exec(cmd, exitOnFailure);
+    return taur_exec(cmd, exitOnFailure, { cwd }, logFile);
 }
 
 /** Convinient way to executes pacman commands with taur_exec() and keep the program running without existing
@@ -540,10 +741,11 @@ bool makepkg_exec(std::vector<std::string> const& args, const bool exitOnFailure
  * @param args The packages to be installed
  * @param exitOnFailure Whether to call exit(1) on command failure. (Default true)
  * @param root If pacman should be executed as root (Default true)
+ * @param flags Extra options passed before the packages, e.g --needed
  * @return true if the command successed, else false
  */
 bool pacman_exec(const std::string_view op, std::vector<std::string> const& args, const bool exitOnFailure,
-                 const bool root)
+                 const bool root, std::vector<std::string> const& flags)
 {
     std::vector<std::string> cmd;
 
@@ -562,6 +764,10 @@ bool pacman_exec(const std::string_view op, std::vector<std::string> const& args
 
     cmd.push_back("--config");
     cmd.push_back(config->pmConfig);
+
+    for (auto& str : flags)
+        cmd.push_back(str);
+
     cmd.push_back("--");
 
     for (auto& str : args)
@@ -658,88 +864,6 @@ void printLocalFullPkgInfo(alpm_pkg_t* pkg)
     fmt::print("\n");
 }
 
-/* Get file value from a file and trim quotes and double-quotes
- * @param iterIndex The iteration index used for getting the necessary value only tot times
- * @param line The string used in std::getline
- * @param str The string to assign the trimmed value, inline
- * @param amount The amount to be used in the line.substr() (should be used with something like "foobar"_len)
- */
-void getFileValue(u_short& iterIndex, const std::string& line, std::string& str, const size_t& amount)
-{
-    str = line.substr(amount);
-    str.erase(std::remove(str.begin(), str.end(), '\"'), str.end());
-    str.erase(std::remove(str.begin(), str.end(), '\''), str.end());
-    iterIndex++;
-}
-
-// faster than `makepkg --packagelist`
-std::string makepkg_list(const std::string_view pkg_name, const std::string_view path)
-{
-    std::ifstream pkgbuild_f(fmt::format("{}/PKGBUILD", path), std::ios::in);
-
-    /*std::string versionInfo = shell_exec("grep 'pkgver=' " + path +
-                                         "/PKGBUILD | cut -d= -f2 | cut -d' ' -f1 | sed -e \"s/'//g\" -e 's/\"//g'");
-    std::string pkgrel      = shell_exec("grep 'pkgrel=' " + path +
-                                         "/PKGBUILD | cut -d= -f2 | cut -d' ' -f1 | sed -e \"s/'//g\" -e 's/\"//g'");
-    std::string epoch       = shell_exec("grep 'epoch=' " + path +
-                                         "/PKGBUILD | cut -d= -f2 | cut -d' ' -f1 | sed -e \"s/'//g\" -e 's/\"//g'");
-    std::string arch_field
-                            = shell_exec("awk -F '[()]' '/^arch=/ {gsub(/\"/,\"\",$2); print $2}' " + path +
-                                        "/PKGBUILD | sed -e \"s/'//g\" -e 's/\"//g'");*/
-
-    std::string versionInfo, pkgrel, epoch, arch_field;
-    u_short     iterIndex = 0;
-
-    std::string line;
-    while (std::getline(pkgbuild_f, line) && iterIndex < 4)
-    {
-        if (hasStart(line, "pkgver="))
-            getFileValue(iterIndex, line, versionInfo, "pkgver="_len);
-
-        else if (hasStart(line, "pkgrel="))
-            getFileValue(iterIndex, line, pkgrel, "pkgrel="_len);
-
-        else if (hasStart(line, "epoch="))
-            getFileValue(iterIndex, line, epoch, "epoch="_len);
-
-        else if (hasStart(line, "arch=("))
-        {
-            getFileValue(iterIndex, line, arch_field, "arch=("_len);
-            arch_field.pop_back();
-        }
-    }
-
-    if (!pkgrel.empty() && pkgrel[0] != '\0')
-        versionInfo += '-' + pkgrel;
-
-    if (!epoch.empty() && epoch[0] != '\0')
-        versionInfo = epoch + ':' + versionInfo;
-
-    /*std::string arch =
-        shell_exec("grep 'CARCH=' " + config->makepkgConf + " | cut -d= -f2 | sed -e \"s/'//g\" -e 's/\"//g'");
-
-    std::string pkgext =
-        shell_exec("grep 'PKGEXT=' " + config->makepkgConf + " | cut -d= -f2 | sed -e \"s/'//g\" -e 's/\"//g'");*/
-
-    std::ifstream makepkgConf(config->makepkgConf, std::ios::in);
-    std::string   arch, pkgext;
-    iterIndex = 0;
-
-    while (std::getline(makepkgConf, line) && iterIndex < 2)
-    {
-        if (hasStart(line, "CARCH="))
-            getFileValue(iterIndex, line, arch, "CARCH="_len);
-
-        else if (hasStart(line, "PKGEXT="))
-            getFileValue(iterIndex, line, pkgext, "PKGEXT="_len);
-    }
-
-    if (arch_field == "any")
-        arch = "any";
-
-    return fmt::format("{}/{}-{}-{}{}", path, pkg_name, versionInfo, arch, pkgext);
-}
-
 /** Search a DB using libalpm
  * Why? well, alpm_db_search searches for results that match ALL regex patterns, this one searches for results that
  * match ANY regex pattern.
@@ -785,42 +909,530 @@ bool util_db_search(alpm_db_t* db, alpm_list_t* needles, alpm_list_t** ret)
     return "";
 }*/
 
-std::vector<std::string> load_aur_list()
+// "TAURIDX" followed by the format version
+inline constexpr std::string_view AUR_INDEX_MAGIC = "TAURIDX1";
+
+/** Map a whole file into memory, read only.
+ * @param file_path the file
+ * @param minSize the smallest size the file can have, e.g its header
+ * @param size set to the size of the file
+ * @return the mapping, to be freed with munmap(), or nullptr if the file couldn't be mapped or is too small
+ */
+void* map_file(const path& file_path, const size_t minSize, size_t& size)
+{
+    const int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < minSize)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    void* map = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return nullptr;
+
+    size = file_stat.st_size;
+    return map;
+}
+
+// SHA-256 through OpenSSL, which cpr already links
+class Sha256
+{
+public:
+    Sha256() : ctx(EVP_MD_CTX_new(), EVP_MD_CTX_free)
+    { EVP_DigestInit_ex(ctx.get(), EVP_sha256(), nullptr); }
+
+    void update(const void* data, const size_t size)
+    { EVP_DigestUpdate(ctx.get(), data, size); }
+
+    std::string hex()
+    {
+        std::array<unsigned char, EVP_MAX_MD_SIZE> digest;
+        unsigned int                               length = 0;
+        EVP_DigestFinal_ex(ctx.get(), digest.data(), &length);
+
+        std::string out;
+        out.reserve(length * 2);
+        for (unsigned int i = 0; i < length; ++i)
+            out += fmt::format("{:02x}", digest[i]);
+
+        return out;
+    }
+
+private:
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx;
+};
+
+/** Hash a string with SHA-256.
+ * @return the hash, in hex
+ */
+std::string sha256_hex(const std::string_view data)
+{
+    Sha256 hash;
+    hash.update(data.data(), data.size());
+    return hash.hex();
+}
+
+/** Hash a file with SHA-256.
+ * @return the hash, in hex, or empty if the file couldn't be read
+ */
+std::string sha256_file(const path& file_path)
+{
+    const int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return {};
+
+    Sha256                      hash;
+    std::array<char, 64 * 1024> buffer;
+    ssize_t                     length;
+
+    while ((length = read(fd, buffer.data(), buffer.size())) > 0)
+        hash.update(buffer.data(), length);
+
+    close(fd);
+    return length < 0 ? std::string() : hash.hex();
+}
+
+AurList::~AurList()
+{
+    if (this->map)
+        munmap(this->map, this->mapSize);
+}
+
+/** Map an index made by write_aur_index()
+ * @param index_path the index file
+ * @return true on success, false if the file is missing or doesn't look like an index
+ */
+bool AurList::load(const path& index_path)
+{
+    size_t size;
+    void*  map = map_file(index_path, AUR_INDEX_MAGIC.length() + sizeof(uint32_t), size);
+    if (!map)
+        return false;
+
+    const char* data = static_cast<const char*>(map);
+
+    uint32_t count;
+    std::memcpy(&count, data + AUR_INDEX_MAGIC.length(), sizeof(count));
+
+    const uint32_t* offsets    = reinterpret_cast<const uint32_t*>(data + AUR_INDEX_MAGIC.length() + sizeof(count));
+    const size_t    namesStart = AUR_INDEX_MAGIC.length() + sizeof(uint32_t) * (static_cast<size_t>(count) + 2);
+
+    // count is checked first, it's whatever the file says and anything computed from it could be way off
+    if (std::string_view(data, AUR_INDEX_MAGIC.length()) != AUR_INDEX_MAGIC || count > size / sizeof(uint32_t) ||
+        namesStart > size || offsets[count] > size - namesStart)
+    {
+        munmap(map, size);
+        return false;
+    }
+
+    if (this->map)
+        munmap(this->map, this->mapSize);
+
+    this->map     = map;
+    this->mapSize = size;
+    this->count   = count;
+    this->offsets = offsets;
+    this->names   = data + namesStart;
+
+    return true;
+}
+
+std::string_view AurList::at(const size_t i) const
+{ return std::string_view(this->names + this->offsets[i], this->offsets[i + 1] - this->offsets[i]); }
+
+bool AurList::contains(const std::string_view name) const
 {
-    const path&   file_path = config->cacheDir / "packages.aur";
-    std::ifstream infile(file_path);
+    size_t left = 0, right = this->count;
+
+    while (left < right)
+    {
+        const size_t mid = left + (right - left) / 2;
+        const int    cmp = this->at(mid).compare(name);
+
+        if (cmp == 0)
+            return true;
+        else if (cmp < 0)
+            left = mid + 1;
+        else
+            right = mid;
+    }
+
+    return false;
+}
+
+/** Turn packages.aur (one name per line) into the sorted index AurList uses.
+ * @param list_path the packages.aur file
+ * @param index_path where to write the index
+ * @return true on success
+ */
+bool write_aur_index(const path& list_path, const path& index_path)
+{
+    std::ifstream infile(list_path, std::ios::binary);
     if (!infile.good())
-        die(_("Failed to open {}"), file_path.c_str());
+        return false;
+
+    const std::string list{ std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>() };
+
+    std::vector<std::string_view> names;
+    names.reserve(list.size() / 12);  // the average name is a bit shorter than that
+
+    for (size_t pos = 0, end; pos < list.size(); pos = end + 1)
+    {
+        end = list.find('\n', pos);
+        if (end == std::string::npos)
+            end = list.size();
+
+        const std::string_view name(list.data() + pos, end - pos);
+        // the file starts with a comment about when it was generated
+        if (!name.empty() && name[0] != '#')
+            names.push_back(name);
+    }
 
-    std::vector<std::string> aur_list;
-    std::string              pkg;
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
 
-    while (std::getline(infile, pkg))
-        aur_list.push_back(pkg);
+    std::vector<uint32_t> offsets;
+    offsets.reserve(names.size() + 1);
 
+    uint32_t offset = 0;
+    for (const std::string_view name : names)
+    {
+        offsets.push_back(offset);
+        offset += name.length();
+    }
+    offsets.push_back(offset);
+
+    const uint32_t count    = names.size();
+    const path&    tmp_path = fmt::format("{}.{}", index_path.string(), getpid());
+    std::ofstream  outfile(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!outfile.is_open())
+        return false;
+
+    outfile.write(AUR_INDEX_MAGIC.data(), AUR_INDEX_MAGIC.length());
+    outfile.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    outfile.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+    for (const std::string_view name : names)
+        outfile.write(name.data(), name.length());
+
+    outfile.close();
+    if (!outfile)
+        return false;
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, index_path, ec);
+
+    return !ec;
+}
+
+/** Get the list of AUR packages.
+ * It is mapped the first time this is called and shared by every caller after that.
+ * The index is rebuilt from packages.aur if it's missing or outdated.
+ */
+const AurList& load_aur_list()
+{
+    static AurList aur_list;
+    static bool    loaded = false;
+
+    if (loaded)
+        return aur_list;
+
+    const path& list_path  = config->cacheDir / "packages.aur";
+    const path& index_path = config->cacheDir / "packages.aur.idx";
+
+    std::error_code ec;
+    const auto&     list_time  = std::filesystem::last_write_time(list_path, ec);
+    const auto&     index_time = std::filesystem::last_write_time(index_path, ec);
+
+    if ((!std::filesystem::exists(index_path) || index_time < list_time) && !write_aur_index(list_path, index_path))
+        die(_("Failed to open {}"), list_path.c_str());
+
+    if (!aur_list.load(index_path))
+        die(_("Failed to open {}"), index_path.c_str());
+
+    loaded = true;
     return aur_list;
 }
 
-bool download_aur_cache(const path& file_path)
+/** Strip the version constraint off a dependency string.
+ * e.g "foo>=1.0" becomes "foo"
+ * @param depend the dependency, as found in depends/makedepends
+ * @return a view of the package name
+ */
+std::string_view getDependName(const std::string_view depend)
+{ return depend.substr(0, depend.find_first_of("<>=")); }
+
+/** Keep a single copy of a string for the rest of the program's life.
+ * Package fields like licenses and dependencies repeat a lot between packages, so they're stored once,
+ * packed in big blocks, instead of as a std::string each. Safe to call from many threads at once.
+ * @param str the string to store
+ * @return a view of the stored copy, which is null-terminated
+ */
+std::string_view intern_str(const std::string_view str)
+{
+    constexpr size_t blockSize = 64 * 1024;
+
+    static std::mutex                           mutex;
+    static std::unordered_set<std::string_view> strings;
+    static std::vector<std::unique_ptr<char[]>> blocks;
+    static char*                                current = nullptr;
+    static size_t                               left    = 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const auto& it = strings.find(str);
+    if (it != strings.end())
+        return *it;
+
+    const size_t size = str.size() + 1;
+    char*        dest;
+
+    // big strings get a block of their own, so they don't waste the rest of the current one
+    if (size > blockSize / 4)
+    {
+        blocks.emplace_back(new char[size]);
+        dest = blocks.back().get();
+    }
+    else
+    {
+        if (size > left)
+        {
+            blocks.emplace_back(new char[blockSize]);
+            current = blocks.back().get();
+            left    = blockSize;
+        }
+
+        dest = current;
+        current += size;
+        left -= size;
+    }
+
+    std::memcpy(dest, str.data(), str.size());
+    dest[str.size()] = '\0';
+
+    return *strings.emplace(dest, str.size()).first;
+}
+
+/** Build the AUR info request urls for a list of packages, splitting it so that no url gets longer than maxLength.
+ * The names are url-encoded, a name too long to fit with any other gets a url of its own.
+ * @param pkgs the names of the packages
+ * @param maxLength the longest url we want to send, in bytes
+ * @return the urls, each with the index in pkgs of the first package it doesn't have
+ */
+std::vector<std::pair<std::string, size_t>> make_info_urls(std::vector<std::string> const& pkgs,
+                                                           const size_t                    maxLength)
+{
+    constexpr std::string_view base = AUR_RPC_INFO_URL;
+
+    std::vector<std::pair<std::string, size_t>> urls;
+    std::string                                 url{ base };
+
+    for (size_t i = 0; i < pkgs.size(); ++i)
+    {
+        const std::string& arg = "arg%5B%5D=" + std::string(cpr::util::urlEncode(pkgs[i]));
+
+        if (url.length() > base.length())
+        {
+            if (url.length() + 1 + arg.length() > maxLength)
+            {
+                urls.emplace_back(std::move(url), i);
+                url = base;
+            }
+            else
+                url += '&';
+        }
+
+        url += arg;
+    }
+
+    if (url.length() > base.length())
+        urls.emplace_back(std::move(url), pkgs.size());
+
+    return urls;
+}
+
+/** Get which packages an url of make_info_urls() asks about.
+ * @param urls what make_info_urls() returned
+ * @param i the index of the url
+ * @return the index of its first package and the index of the first package it doesn't have, in the list of packages
+ * given to make_info_urls()
+ */
+std::pair<size_t, size_t> info_url_range(std::vector<std::pair<std::string, size_t>> const& urls, const size_t i)
+{ return { i == 0 ? 0 : urls[i - 1].second, urls[i].second }; }
+
+// Writes whatever it's given into a file, inflating it on the way if it turns out to be gzip compressed.
+// curl already takes care of Content-Encoding, this is for when the server sends the .gz file as-is.
+class GzipFileWriter
 {
-    const cpr::Response& r = cpr::Get(cpr::Url{ AUR_URL "/packages.gz" });
+public:
+    GzipFileWriter(const path& file_path, const bool inflate)
+        : file(file_path, std::ios::binary | std::ios::trunc), checked(!inflate)
+    {}
+    ~GzipFileWriter()
+    {
+        if (this->gzip)
+            inflateEnd(&this->stream);
+    }
+
+    bool is_open() const { return this->file.is_open(); }
 
-    if (r.status_code == 200)
+    bool write(const std::string_view data)
     {
-        std::ofstream outfile(file_path, std::ios::trunc);
-        if (!outfile.is_open())
+        if (data.empty() || this->failed)
+            return !this->failed;
+
+        if (!this->checked)
+        {
+            this->checked = true;
+            this->gzip    = data.length() >= 2 && static_cast<unsigned char>(data[0]) == 0x1f &&
+                            static_cast<unsigned char>(data[1]) == 0x8b;
+
+            // 16 + MAX_WBITS tells zlib to expect a gzip header
+            if (this->gzip && inflateInit2(&this->stream, 16 + MAX_WBITS) != Z_OK)
+                return !(this->failed = true);
+        }
+
+        if (!this->gzip)
+            return !(this->failed = !this->file.write(data.data(), data.length()));
+
+        std::array<char, 64 * 1024> buffer;
+        this->stream.next_in  = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        this->stream.avail_in = data.length();
+
+        while (this->stream.avail_in > 0)
         {
-            log_println(ERROR, _("Failed to open/write {}"), file_path.c_str());
+            this->stream.next_out  = reinterpret_cast<Bytef*>(buffer.data());
+            this->stream.avail_out = buffer.size();
+
+            const int ret = inflate(&this->stream, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END)
+                return !(this->failed = true);
+
+            if (!this->file.write(buffer.data(), buffer.size() - this->stream.avail_out))
+                return !(this->failed = true);
+
+            if (ret == Z_STREAM_END)
+                break;
+        }
+
+        return true;
+    }
+
+    bool finish()
+    {
+        this->file.close();
+        return !this->failed && this->file;
+    }
+
+private:
+    std::ofstream file;
+    z_stream      stream{};
+    bool          checked = false;
+    bool          gzip    = false;
+    bool          failed  = false;
+};
+
+/** Download a file, unless it didn't change since the last download.
+ * The ETag and Last-Modified headers of the last download are kept next to it, in <file>.headers,
+ * that file is rewritten every time we check, so its mtime tells when the file was last validated.
+ * @param url where to download it from
+ * @param file_path where to save it
+ * @param changed set to whether a new file was downloaded
+ * @param inflate whether to inflate the file if the server sends it gzip compressed
+ * @return true if the file is now up to date
+ */
+bool download_if_modified(const std::string_view url, const path& file_path, bool& changed, const bool inflate)
+{
+    changed = false;
+
+    const path& headers_path = path(file_path) += ".headers";
+    const path& tmp_path     = fmt::format("{}.{}", file_path.string(), getpid());
+
+    std::string   etag, last_modified;
+    std::ifstream headers_file(headers_path);
+    std::getline(headers_file, etag);
+    std::getline(headers_file, last_modified);
+    headers_file.close();
+
+    cpr::Header header;
+    if (std::filesystem::exists(file_path))
+    {
+        if (!etag.empty())
+            header["If-None-Match"] = etag;
+        if (!last_modified.empty())
+            header["If-Modified-Since"] = last_modified;
+    }
+
+    cpr::Session session;
+    session.SetUrl(cpr::Url{ url });
+    session.SetHeader(header);
+
+    GzipFileWriter writer(tmp_path, inflate);
+    if (!writer.is_open())
+    {
+        log_println(ERROR, _("Failed to open/write {}"), tmp_path.c_str());
+        return false;
+    }
+
+    // stream the body straight into the file instead of keeping the whole list in memory
+    const cpr::Response& r = session.Download(
+        cpr::WriteCallback([&writer](const std::string_view data, intptr_t) { return writer.write(data); }));
+
+    const bool written = writer.finish();
+    std::error_code ec;
+
+    if (r.status_code == 304)
+    {
+        log_println(DEBUG, "{} didn't change since the last download", file_path.string());
+        std::filesystem::remove(tmp_path, ec);
+    }
+    else if (r.status_code == 200 && written)
+    {
+        const auto& etag_it          = r.header.find("ETag");
+        const auto& last_modified_it = r.header.find("Last-Modified");
+        etag                         = etag_it != r.header.end() ? etag_it->second : "";
+        last_modified                = last_modified_it != r.header.end() ? last_modified_it->second : "";
+
+        std::filesystem::rename(tmp_path, file_path, ec);
+        if (ec)
+        {
+            log_println(ERROR, _("Failed to open/write {}"), file_path.string());
             return false;
         }
-        outfile << r.text;
+
+        changed = true;
     }
     else
     {
+        std::filesystem::remove(tmp_path, ec);
         log_println(ERROR, _("Failed to download {} with status code: {}"), r.url.str(), r.status_code);
         return false;
     }
 
+    std::ofstream(headers_path, std::ios::trunc) << etag << '\n' << last_modified << '\n';
+
+    return true;
+}
+
+// Download packages.aur if it changed, and index it.
+static bool download_aur_cache(const path& file_path)
+{
+    bool changed;
+    if (!download_if_modified(AUR_URL "/packages.gz", file_path, changed))
+        return false;
+
+    if (changed && !write_aur_index(file_path, path(file_path) += ".idx"))
+    {
+        log_println(ERROR, _("Failed to open/write {}"), file_path.string());
+        return false;
+    }
+
     return true;
 }
 
@@ -846,13 +1458,17 @@ bool update_aur_cache(const bool recursiveCall)
         return false;
     }
 
-    auto _current_time    = std::chrono::system_clock::now();
-    auto _timeoutDuration = std::chrono::hours(24 * 5);
+    // a negative max age means the list is never refreshed automatically
+    if (config->aurListMaxAge < 0)
+        return true;
 
-    auto        timeout    = std::chrono::duration_cast<std::chrono::seconds>(_timeoutDuration).count();
-    std::time_t now_time_t = std::chrono::system_clock::to_time_t(_current_time);
+    // packages.aur.headers is rewritten every time we check the list, even if it didn't change.
+    struct stat check_stat;
+    const path& headers_path = path(file_path) += ".headers";
+    const time_t last_check  = stat(headers_path.c_str(), &check_stat) == 0 ? check_stat.st_mtim.tv_sec
+                                                                           : file_stat.st_mtim.tv_sec;
 
-    if (file_stat.st_mtim.tv_sec < now_time_t - timeout)
+    if (last_check <= std::time(nullptr) - config->aurListMaxAge * 60 * 60)
     {
         log_println(INFO, _("Refreshing {}"), file_path.string());
         download_aur_cache(file_path);
@@ -861,6 +1477,38 @@ bool update_aur_cache(const bool recursiveCall)
     return true;
 }
 
+/** Get the full information (e.g dependencies) of the AUR packages in a search result, with batched info requests.
+ * @param pkgs the packages, system packages and the ones that couldn't be fetched are left as they are
+ * @param backend the backend used to fetch them
+ * @param useGit whether the fetched packages should use a .git url
+ * @return pkgs, with their AUR packages replaced by the fetched ones
+ */
+static std::vector<TaurPkg_t> fetchFullInfo(std::vector<TaurPkg_t>&& pkgs, TaurBackend& backend, const bool useGit)
+{
+    std::vector<std::string> names;
+    for (const TaurPkg_t& pkg : pkgs)
+        if (!pkg.aur_url.empty())
+            names.push_back(pkg.name);
+
+    if (names.empty())
+        return std::move(pkgs);
+
+    std::vector<TaurPkg_t> fetched = backend.fetch_pkgs(names, useGit);
+
+    for (TaurPkg_t& pkg : pkgs)
+    {
+        if (pkg.aur_url.empty())
+            continue;
+
+        const auto& it = std::find_if(fetched.begin(), fetched.end(),
+                                      [&pkg](const TaurPkg_t& fetchedPkg) { return fetchedPkg.name == pkg.name; });
+        if (it != fetched.end())
+            pkg = std::move(*it);
+    }
+
+    return std::move(pkgs);
+}
+
 /** Ask the user to select a package out of a list.
  * @param pkgs The list of packages, in a vector
  * @param backend A reference to the TaurBackend responsible for fetching any AUR packages.
@@ -872,9 +1520,7 @@ std::optional<std::vector<TaurPkg_t>> askUserForPkg(const std::vector<TaurPkg_t>
 {
     if (pkgs.size() == 1)
     {
-        return pkgs[0].aur_url.empty()
-                   ? pkgs
-                   : std::vector<TaurPkg_t>({ backend.fetch_pkg(pkgs[0].name, useGit).value_or(pkgs[0]) });
+        return fetchFullInfo(std::vector<TaurPkg_t>(pkgs), backend, useGit);
     }
     else if (pkgs.size() > 1)
     {
@@ -910,12 +1556,10 @@ std::optional<std::vector<TaurPkg_t>> askUserForPkg(const std::vector<TaurPkg_t>
             if (selected >= pkgs.size())
                 continue;
 
-            output.push_back(pkgs[selected].aur_url.empty()
-                                 ? pkgs[selected]
-                                 : backend.fetch_pkg(pkgs[selected].name, useGit).value_or(pkgs[selected]));
+            output.push_back(pkgs[selected]);
         }
 
-        return output;
+        return fetchFullInfo(std::move(output), backend, useGit);
     }
 
     return {};
@@ -929,59 +1573,44 @@ void ctrl_d_handler(const std::istream& cin)
 
 /** Filters out/only AUR packages.
  * Default behavior is filtering out.
- * @param pkgs a unique_ptr to a list of packages to filter.
+ * @param pkgs a list of packages to filter.
+ * @param syncdbs the sync databases, anything that isn't in them is considered an AUR package.
  * @param inverse a bool that, if true, will return only AUR packages instead of the other way around.
- * @return an optional unique_ptr to a result.
+ * @return the packages that were kept.
  */
-std::vector<alpm_pkg_t*> filterAURPkgs(std::vector<alpm_pkg_t*>& pkgs, alpm_list_t* syncdbs, bool inverse)
+std::vector<alpm_pkg_t*> filterAURPkgs(const std::vector<alpm_pkg_t*>& pkgs, alpm_list_t* syncdbs,
+                                       const bool inverse)
 {
+    const std::unordered_set<std::string_view>& syncPkgs = get_sync_pkg_names(syncdbs);
+
     std::vector<alpm_pkg_t*> out;
     out.reserve(pkgs.size());
 
-    for (; syncdbs; syncdbs = syncdbs->next)
-    {
-        for (size_t i = 0; i < pkgs.size(); i++)
-        {
-            bool existsInSync = alpm_db_get_pkg((alpm_db_t*)(syncdbs->data), alpm_pkg_get_name(pkgs[i])) != nullptr;
-
-            if ((existsInSync && inverse) || (!existsInSync && !inverse))
-                pkgs[i] = nullptr;
-        }
-    }
-
-    for (size_t i = 0; i < pkgs.size(); i++)
-        if (pkgs[i])
-            out.push_back(pkgs[i]);
+    for (alpm_pkg_t* pkg : pkgs)
+        if (syncPkgs.contains(alpm_pkg_get_name(pkg)) != inverse)
+            out.push_back(pkg);
 
     return out;
 }
 
 /** Filters out/only AUR packages (names only).
  * Default behavior is filtering out.
- * @param pkgs a unique_ptr to a list of packages to filter.
+ * @param pkgs a list of packages to filter.
+ * @param syncdbs the sync databases, anything that isn't in them is considered an AUR package.
  * @param inverse a bool that, if true, will return only AUR packages instead of the other way around.
- * @return an optional unique_ptr to a result.
+ * @return the packages that were kept.
  */
-std::vector<std::string_view> filterAURPkgsNames(std::vector<std::string_view>& pkgs, alpm_list_t* syncdbs,
-                                                 bool inverse)
+std::vector<std::string_view> filterAURPkgsNames(const std::vector<std::string_view>& pkgs, alpm_list_t* syncdbs,
+                                                 const bool inverse)
 {
+    const std::unordered_set<std::string_view>& syncPkgs = get_sync_pkg_names(syncdbs);
+
     std::vector<std::string_view> out;
     out.reserve(pkgs.size());
 
-    for (; syncdbs; syncdbs = syncdbs->next)
-    {
-        for (size_t i = 0; i < pkgs.size(); i++)
-        {
-            bool existsInSync = alpm_db_get_pkg((alpm_db_t*)(syncdbs->data), pkgs[i].data()) != nullptr;
-
-            if ((existsInSync && inverse) || (!existsInSync && !inverse))
-                pkgs[i] = "";
-        }
-    }
-
-    for (size_t i = 0; i < pkgs.size(); i++)
-        if (pkgs[i].length())
-            out.push_back(pkgs[i]);
+    for (const std::string_view pkg : pkgs)
+        if (syncPkgs.contains(pkg) != inverse)
+            out.push_back(pkg);
 
     return out;
 }
@@ -0,0 +1,72 @@
+#include "catch2/catch_amalgamated.hpp"
+#include "buildcache.hpp"
+#include "config.hpp"
+#include "util.hpp"
+using Catch::Matchers::Equals;
+
+#include <fstream>
+#include <memory>
+
+const std::string& configDir  = getConfigDir();
+std::string        configfile = (configDir + "/config.toml");
+std::string        themefile  = (configDir + "/theme.toml");
+
+std::unique_ptr<Config> config = std::make_unique<Config>(configfile, themefile, configDir);
+
+TEST_CASE("buildcache.cpp test suitcase", "[BuildCache]")
+{
+    const path& pkg_dir = "/tmp/taur_test_build/foo";
+    std::filesystem::remove_all("/tmp/taur_test_build");
+    std::filesystem::create_directories(pkg_dir);
+
+    config->makepkgConf   = "/tmp/taur_test_build/makepkg.conf";
+    config->buildCacheDir = "/tmp/taur_test_build/cache";
+
+    std::ofstream(config->makepkgConf) << "CARCH=\"x86_64\"\nPKGEXT='.pkg.tar.zst'\n";
+    std::ofstream(pkg_dir / "PKGBUILD") << "pkgname=foo\npkgver=1.0\npkgrel=1\narch=('any')\n";
+    std::ofstream(pkg_dir / "fix.patch") << "--- a\n+++ b\n";
+    std::ofstream(pkg_dir / ".SRCINFO") << "pkgbase = foo\n\tpkgver = 1.0\n\tpkgrel = 1\n\tarch = any\n"
+                                           "\tsource = foo-1.0.tar.gz::https://example.org/foo-1.0.tar.gz\n"
+                                           "\tsource = fix.patch\n\tsha256sums = SKIP\n\tsha256sums = SKIP\n\n"
+                                           "pkgname = foo\n";
+
+    SECTION("Keys")
+    {
+        const std::string& key = build_cache_key("foo", pkg_dir);
+        REQUIRE(key.length() == 64);
+        REQUIRE(build_cache_key("foo", pkg_dir) == key);
+
+        // a local source changed
+        std::ofstream(pkg_dir / "fix.patch", std::ios::app) << "+more\n";
+        REQUIRE(build_cache_key("foo", pkg_dir) != key);
+
+        std::filesystem::remove(pkg_dir / "fix.patch");
+        REQUIRE(build_cache_key("foo", pkg_dir).empty());
+
+        REQUIRE(build_cache_key("foo-git", pkg_dir).empty());
+        REQUIRE(build_cache_key("foo", "/tmp/taur_test_build").empty());
+    }
+
+    SECTION("Storing and restoring")
+    {
+        const std::string& key = build_cache_key("foo", pkg_dir);
+        REQUIRE_FALSE(restore_cached_build(key, pkg_dir));
+
+        // there was nothing to strip, so no debug package
+        const std::vector<std::string>& artifacts = { pkg_dir / "foo-1.0-1-any.pkg.tar.zst",
+                                                      pkg_dir / "foo-debug-1.0-1-any.pkg.tar.zst" };
+        REQUIRE_FALSE(store_cached_build(key, artifacts));
+
+        std::ofstream(artifacts[0]) << "package";
+        REQUIRE(store_cached_build(key, artifacts));
+
+        std::filesystem::remove(artifacts[0]);
+        REQUIRE(restore_cached_build(key, pkg_dir));
+        REQUIRE_FALSE(std::filesystem::exists(artifacts[1]));
+
+        std::ifstream restored(pkg_dir / "foo-1.0-1-any.pkg.tar.zst");
+        std::string   content;
+        std::getline(restored, content);
+        REQUIRE_THAT(content, Equals("package"));
+    }
+}
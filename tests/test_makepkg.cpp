@@ -0,0 +1,134 @@
+#include "catch2/catch_amalgamated.hpp"
+#include "config.hpp"
+#include "makepkg.hpp"
+#include "util.hpp"
+using Catch::Matchers::Equals;
+
+#include <fstream>
+#include <memory>
+
+const std::string& configDir  = getConfigDir();
+std::string        configfile = (configDir + "/config.toml");
+std::string        themefile  = (configDir + "/theme.toml");
+
+std::unique_ptr<Config> config = std::make_unique<Config>(configfile, themefile, configDir);
+
+// a split package, like makepkg --printsrcinfo prints it
+constexpr std::string_view SRCINFO = R"(pkgbase = foo
+	pkgdesc = Foo, and its docs
+	pkgver = 1.2.3
+	pkgrel = 2
+	epoch = 1
+	arch = x86_64
+	arch = aarch64
+	makedepends = cmake>=3.20
+	depends = glibc
+	depends_x86_64 = lib32-glibc
+	source = foo-1.2.3.tar.gz::https://example.org/foo/v1.2.3.tar.gz
+	source = fix-build.patch
+	sha256sums = SKIP
+	sha256sums = SKIP
+
+pkgname = foo
+
+pkgname = foo-docs
+	pkgdesc = The docs of foo
+	arch = any
+	depends =
+)";
+
+TEST_CASE("makepkg.cpp test suitcase", "[Makepkg]")
+{
+    SECTION("Parsing")
+    {
+        const std::optional<Srcinfo_t>& srcinfo = parse_srcinfo(SRCINFO);
+        REQUIRE(srcinfo.has_value());
+        REQUIRE(srcinfo->pkgbase == "foo");
+        REQUIRE(srcinfo->pkgnames == std::vector<std::string>{ "foo", "foo-docs" });
+        REQUIRE_THAT(srcinfo->version(), Equals("1:1.2.3-2"));
+        REQUIRE(srcinfo->get("pkgdesc") == "Foo, and its docs");
+        REQUIRE(srcinfo->get("url").empty());
+
+        REQUIRE(srcinfo->getList("depends").size() == 1);
+        REQUIRE(srcinfo->getList("depends", "x86_64").size() == 2);
+        REQUIRE(srcinfo->getList("makedepends")[0] == "cmake>=3.20");
+        REQUIRE(srcinfo->getList("source")[1] == "fix-build.patch");
+
+        REQUIRE(srcinfo->getPkgList("foo", "arch").size() == 2);
+        REQUIRE(srcinfo->getPkgList("foo-docs", "arch")[0] == "any");
+        REQUIRE(srcinfo->getPkgList("foo-docs", "depends").empty());
+        REQUIRE(srcinfo->getPkgList("foo", "depends")[0] == "glibc");
+
+        REQUIRE_FALSE(has_vcs_sources(*srcinfo));
+        REQUIRE_FALSE(parse_srcinfo("pkgname = foo\n").has_value());
+    }
+
+    SECTION("VCS sources")
+    {
+        REQUIRE(is_vcs_source("git+https://github.com/BurntRanch/TabAUR.git"));
+        REQUIRE(is_vcs_source("taur::git+https://github.com/BurntRanch/TabAUR.git#branch=main"));
+        REQUIRE(is_vcs_source("git://example.org/foo.git"));
+        REQUIRE_FALSE(is_vcs_source("https://example.org/git+foo.tar.gz"));
+        REQUIRE_FALSE(is_vcs_source("fix-build.patch"));
+    }
+
+    SECTION("Package folders")
+    {
+        std::filesystem::create_directories("/tmp/taur_test_makepkg");
+        std::ofstream("/tmp/taur_test_makepkg/.SRCINFO") << SRCINFO;
+
+        const std::optional<Srcinfo_t>& srcinfo = get_srcinfo("/tmp/taur_test_makepkg");
+        REQUIRE(srcinfo.has_value());
+        REQUIRE_THAT(srcinfo->version(), Equals("1:1.2.3-2"));
+    }
+
+    SECTION("makepkg.conf")
+    {
+        std::filesystem::remove_all("/tmp/taur_test_makepkg_conf");
+        std::filesystem::create_directories("/tmp/taur_test_makepkg_conf/makepkg.conf.d");
+        std::filesystem::create_directories("/tmp/taur_test_makepkg_conf/home");
+        setenv("XDG_CONFIG_HOME", "/tmp/taur_test_makepkg_conf/home", 1);
+        setenv("HOME", "/tmp/taur_test_makepkg_conf/home", 1);
+        setenv("PKGDEST", "/tmp/taur_test_makepkg_conf/packages", 1);
+        unsetenv("PKGEXT");
+        unsetenv("CARCH");
+
+        std::ofstream("/tmp/taur_test_makepkg_conf/makepkg.conf") << R"(#!/hint/bash
+CARCH="x86_64"
+CFLAGS="-march=x86-64 -O2" # the flags
+CXXFLAGS="$CFLAGS -Wp,-D_GLIBCXX_ASSERTIONS"
+BUILDENV=(!distcc color
+          !ccache check)
+BUILDENV+=(sign)
+PKGEXT='.pkg.tar.zst'
+export PKGDEST=/tmp/elsewhere
+for ext in zst xz; do PKGEXT=".pkg.tar.$ext"; done
+if [[ -n $FOO ]]; then
+    CARCH=i686
+fi
+)";
+        std::ofstream("/tmp/taur_test_makepkg_conf/makepkg.conf.d/fast.conf") << "PKGEXT=.pkg.tar\n";
+
+        MakepkgConf conf;
+        REQUIRE(conf.load("/tmp/taur_test_makepkg_conf/makepkg.conf"));
+        REQUIRE(conf.get("CARCH") == "x86_64");
+        REQUIRE(conf.get("CXXFLAGS") == "-march=x86-64 -O2 -Wp,-D_GLIBCXX_ASSERTIONS");
+        REQUIRE(conf.getList("BUILDENV") == std::vector<std::string>{ "!distcc", "color", "!ccache", "check", "sign" });
+        REQUIRE(conf.get("PKGEXT") == ".pkg.tar");
+        REQUIRE(conf.get("PKGDEST") == "/tmp/taur_test_makepkg_conf/packages");
+        REQUIRE(conf.get("SRCDEST").empty());
+        REQUIRE(conf.fingerprint().length() == 64);
+
+        // the user's makepkg.conf comes last
+        std::filesystem::create_directories("/tmp/taur_test_makepkg_conf/home/pacman");
+        std::ofstream("/tmp/taur_test_makepkg_conf/home/pacman/makepkg.conf") << "CARCH=aarch64\n";
+
+        MakepkgConf userConf;
+        REQUIRE(userConf.load("/tmp/taur_test_makepkg_conf/makepkg.conf"));
+        REQUIRE(userConf.get("CARCH") == "aarch64");
+        REQUIRE(userConf.fingerprint() != conf.fingerprint());
+
+        REQUIRE_FALSE(MakepkgConf().load("/tmp/taur_test_makepkg_conf/nope.conf"));
+        unsetenv("PKGDEST");
+    }
+}
@@ -0,0 +1,77 @@
+#include "catch2/catch_amalgamated.hpp"
+#include "config.hpp"
+#include "metadata.hpp"
+#include "util.hpp"
+using Catch::Matchers::Equals;
+
+#include <memory>
+
+const std::string& configDir  = getConfigDir();
+std::string        configfile = (configDir + "/config.toml");
+std::string        themefile  = (configDir + "/theme.toml");
+
+std::unique_ptr<Config> config = std::make_unique<Config>(configfile, themefile, configDir);
+
+TEST_CASE("metadata.cpp test suitcase", "[Metadata]")
+{
+    // zlib reads it as it is when it's not compressed
+    std::ofstream("/tmp/taur_test_meta.json") << R"([
+        {"ID":1,"Name":"yay","Version":"12.3.5-1","Description":"Yet another yogurt",
+         "URL":"https://github.com/Jguer/yay",
+         "URLPath":"/cgit/aur.git/snapshot/yay.tar.gz","Maintainer":"jguer","NumVotes":2000,"Popularity":40.5,
+         "OutOfDate":null,"LastModified":1700000000,"Depends":["pacman>6.1","git"],"MakeDepends":["go>=1.21"],
+         "License":["GPL-3.0-or-later"],"Keywords":["arm","AUR"]},
+        {"ID":2,"Name":"foo-git","Version":"r1-1","Description":null,"URLPath":"/cgit/aur.git/snapshot/foo-git.tar.gz",
+         "Maintainer":null,"NumVotes":0,"Popularity":0,"OutOfDate":1710000000,"LastModified":1600000000,
+         "OptDepends":["yay: to install it"]},
+        {"ID":3,"Name":"yay-bin","Version":"12.3.5-1","Description":"Yet another yogurt, prebuilt","Popularity":1.5,
+         "URLPath":"/cgit/aur.git/snapshot/yay-bin.tar.gz","Maintainer":"someone","Depends":["pacman>6.1"]}
+    ])";
+    REQUIRE(write_aur_metadata("/tmp/taur_test_meta.json", "/tmp/taur_test_meta.idx"));
+
+    AurMetadata metadata;
+    REQUIRE(metadata.load("/tmp/taur_test_meta.idx"));
+    REQUIRE(metadata.size() == 3);
+    REQUIRE(metadata.name(0) == "foo-git");
+
+    SECTION("Info lookups")
+    {
+        const std::optional<TaurPkg_t>& yay = metadata.find("yay", false);
+        REQUIRE(yay.has_value());
+        REQUIRE_THAT(yay->version, Equals("12.3.5-1"));
+        REQUIRE_THAT(yay->aur_url, Equals(AUR_URL "/cgit/aur.git/snapshot/yay.tar.gz"));
+        REQUIRE(yay->maintainer == "jguer");
+        REQUIRE(yay->votes == 2000);
+        REQUIRE(yay->last_modified == 1700000000);
+        REQUIRE(yay->depends().size() == 2);
+        REQUIRE(yay->makedepends().size() == 1);
+        REQUIRE(yay->makedepends()[0] == "go>=1.21");
+        REQUIRE(yay->licenses.size() == 1);
+
+        const std::optional<TaurPkg_t>& foo = metadata.find("foo-git", true);
+        REQUIRE(foo.has_value());
+        REQUIRE(foo->maintainer == "\1");
+        REQUIRE(foo->outofdate == 1710000000);
+        REQUIRE(foo->totaldepends.empty());
+        REQUIRE_THAT(foo->aur_url, Equals(AUR_URL_GIT("foo-git")));
+
+        REQUIRE_FALSE(metadata.find("foo", false).has_value());
+    }
+
+    SECTION("Searching")
+    {
+        const std::optional<std::vector<TaurPkg_t>>& yogurt = metadata.search("YOGURT", "name-desc", false);
+        REQUIRE(yogurt->size() == 2);
+        REQUIRE(yogurt->at(0).name == "yay");  // the most popular first
+
+        REQUIRE(metadata.search("yogurt", "name", false)->empty());
+        REQUIRE(metadata.search("yay prebuilt", "name-desc", false)->at(0).name == "yay-bin");
+        REQUIRE(metadata.search("yay-b", "name", false)->size() == 1);
+        REQUIRE(metadata.search("ay", "name", false)->empty());  // words have to start with it
+        REQUIRE(metadata.search("fo git", "name", false)->size() == 1);
+        REQUIRE(metadata.search("pacman", "depends", false)->at(0).name == "yay");
+        REQUIRE(metadata.search("yay", "optdepends", false)->at(0).name == "foo-git");
+        REQUIRE(metadata.search("jguer", "maintainer", false)->size() == 1);
+        REQUIRE_FALSE(metadata.search("yay", "provides", false).has_value());
+    }
+}
@@ -1,10 +1,386 @@
-#include <memory>
-
+#include "catch2/catch_amalgamated.hpp"
 #include "config.hpp"
+#include "rpc.hpp"
+#include "taur.hpp"
 #include "util.hpp"
+using Catch::Matchers::Equals;
+
+#include <fstream>
+#include <memory>
 
 const std::string& configDir  = getConfigDir();
 std::string        configfile = (configDir + "/config.toml");
 std::string        themefile  = (configDir + "/theme.toml");
 
 std::unique_ptr<Config> config = std::make_unique<Config>(configfile, themefile, configDir);
+
+// an info response, like https://aur.archlinux.org/rpc/v5/info?arg[]=yay&arg[]=yay-bin answers
+constexpr std::string_view INFO_RESPONSE = R"({"resultcount":2,"results":[
+    {"ID":1,"Name":"yay","Version":"12.3.5-1","Description":"Yet another yogurt","URL":"https://github.com/Jguer/yay",
+     "URLPath":"/cgit/aur.git/snapshot/yay.tar.gz","Maintainer":"jguer","NumVotes":2000,"Popularity":40.5,
+     "OutOfDate":null,"LastModified":1700000000,"MakeDepends":["go>=1.21"],"Depends":["pacman>6.1","git"],
+     "OptDepends":["sudo: privilege elevation"],"License":["GPL-3.0-or-later"],"Keywords":["helper","pacman"]},
+    {"ID":2,"Name":"yay-bin","Version":"12.3.5-1","Description":"Yet another yogurt, prebuilt",
+     "URLPath":"/cgit/aur.git/snapshot/yay-bin.tar.gz","Maintainer":null,"NumVotes":300,"Popularity":3,
+     "OutOfDate":1710000000,"LastModified":1700000001,"License":["GPL-3.0-or-later","MIT"]}],
+    "type":"multiinfo","version":5})";
+
+constexpr std::string_view SEARCH_RESPONSE = R"({"resultcount":1,"results":[
+    {"ID":1,"Name":"yay","Version":"12.3.5-1","Description":"Yet another yogurt",
+     "URLPath":"/cgit/aur.git/snapshot/yay.tar.gz","Maintainer":"jguer","NumVotes":2000,"Popularity":40.5,
+     "OutOfDate":null,"LastModified":1700000000}],
+    "type":"search","version":5})";
+
+// only the "results" of the response are packages, and only their known fields are read
+constexpr std::string_view UNKNOWN_FIELDS_RESPONSE = R"({"meta":{"resultcount":5,"results":[{"Name":"nope"}]},
+    "resultcount":1,"warnings":[["Name"],{"results":[{"Name":"nope"}]}],
+    "results":[{"Name":"foo","Version":"1-1","Extra":{"Name":"nope","Depends":["nope"],"List":[{"Version":"0"}]},
+                "Matrix":[[1,"nope"],[]],"Depends":["bar"]}],
+    "type":"multiinfo","version":5})";
+
+// a package depending on the given packages, see TaurPkg_t::totaldepends
+static TaurPkg_t makePkg(const std::string_view name, const std::vector<std::string_view>& depends = {})
+{ return { .name = std::string(name), .totaldepends = depends, .dependsCount = depends.size() }; }
+
+static std::vector<std::string> names(const std::vector<TaurPkg_t>& pkgs)
+{
+    std::vector<std::string> ret;
+    for (const TaurPkg_t& pkg : pkgs)
+        ret.push_back(pkg.name);
+    return ret;
+}
+
+TEST_CASE("taur.cpp test suitcase", "[Taur]")
+{
+    SECTION("Build order")
+    {
+        REQUIRE(sortIndices({ { 1 }, { 2 }, {} }) == std::vector<size_t>{ 2, 1, 0 });
+        REQUIRE(sortIndices({}).empty());
+
+        const std::vector<TaurPkg_t>& chain =
+            sortByDepends({ makePkg("a", { "b" }), makePkg("b", { "c" }), makePkg("c", { "glibc" }) });
+        REQUIRE(names(chain) == std::vector<std::string>{ "c", "b", "a" });
+
+        // dependencies are matched by name, whatever version they ask for
+        const std::vector<TaurPkg_t>& diamond =
+            sortByDepends({ makePkg("top", { "left", "right=2" }), makePkg("left", { "base>=1.0" }),
+                            makePkg("right", { "base<3" }), makePkg("base") });
+        REQUIRE(names(diamond) == std::vector<std::string>{ "base", "left", "right", "top" });
+
+        const std::vector<TaurPkg_t>& self = sortByDepends({ makePkg("foo", { "foo", "bar" }), makePkg("bar") });
+        REQUIRE(names(self) == std::vector<std::string>{ "bar", "foo" });
+
+        // the packages of a cycle go last, in the order they were given
+        REQUIRE(sortIndices({ { 1 }, { 0 }, {} }) == std::vector<size_t>{ 2, 0, 1 });
+
+        const std::vector<TaurPkg_t>& cycle =
+            sortByDepends({ makePkg("a", { "b" }), makePkg("b", { "a>1" }), makePkg("c"), makePkg("d", { "c" }) });
+        REQUIRE(names(cycle) == std::vector<std::string>{ "c", "d", "a", "b" });
+    }
+
+    SECTION("Upgrade candidates")
+    {
+        const std::vector<TaurPkg_t> localPkgs{
+            { .name = "gone", .version = "1.0-1" },
+            { .name = "foo-git", .version = "r10.abc-1" },
+            { .name = "same", .version = "2.0-1" },
+            { .name = "down", .version = "3.0-1" },
+            { .name = "up", .version = "1.0-1" },
+            { .name = "epoch", .version = "2.0-1" },
+            { .name = "pkgrel", .version = "1.0-1" },
+        };
+
+        // the AUR answers in its own order, and doesn't have "gone" anymore
+        std::vector<TaurPkg_t> onlinePkgs{
+            { .name = "pkgrel", .version = "1.0-2" },
+            { .name = "epoch", .version = "1:1.0-1" },
+            { .name = "up", .version = "1.1-1" },
+            { .name = "down", .version = "2.9-1" },
+            { .name = "same", .version = "2.0-1" },
+            { .name = "foo-git", .version = "r5.def-1" },
+        };
+
+        const std::vector<UpgradeCandidate_t>& candidates = findUpgradeCandidates(localPkgs, std::move(onlinePkgs));
+        REQUIRE(candidates.size() == 4);
+
+        // -git packages are always candidates, even when the AUR version is older
+        REQUIRE_THAT(candidates[0].local.name, Equals("foo-git"));
+        REQUIRE_THAT(candidates[0].online.version, Equals("r5.def-1"));
+        REQUIRE(candidates[0].devel);
+
+        REQUIRE_THAT(candidates[1].local.name, Equals("up"));
+        REQUIRE_THAT(candidates[1].local.version, Equals("1.0-1"));
+        REQUIRE_THAT(candidates[1].online.version, Equals("1.1-1"));
+        REQUIRE_FALSE(candidates[1].devel);
+
+        REQUIRE_THAT(candidates[2].online.name, Equals("epoch"));
+        REQUIRE_THAT(candidates[2].online.version, Equals("1:1.0-1"));
+
+        REQUIRE_THAT(candidates[3].online.name, Equals("pkgrel"));
+        REQUIRE_THAT(candidates[3].online.version, Equals("1.0-2"));
+
+        REQUIRE(findUpgradeCandidates(localPkgs, {}).empty());
+    }
+
+    SECTION("Update checks")
+    {
+        const std::vector<UpgradeCandidate_t> candidates{
+            { { .name = "up", .version = "1.0-1" }, { .name = "up", .version = "1.1-1" }, false },
+            { { .name = "new-git", .version = "r1-1" }, { .name = "new-git", .version = "r2-1" }, true },
+            // -git packages whose AUR version isn't newer may not have changed, they're not listed
+            { { .name = "old-git", .version = "r9-1" }, { .name = "old-git", .version = "r2-1" }, true },
+            { { .name = "quote\"d", .version = "1-1" }, { .name = "quote\"d", .version = "2-1" }, false },
+        };
+
+        std::string output;
+
+        REQUIRE(formatUpdates(candidates, false, false, output) == 0);
+        REQUIRE_THAT(output, Equals("up\t1.0-1\t1.1-1\nnew-git\tr1-1\tr2-1\nquote\"d\t1-1\t2-1\n"));
+
+        REQUIRE(formatUpdates(candidates, false, true, output) == 0);
+        REQUIRE_THAT(output, Equals(R"([{"name":"up","installed":"1.0-1","aur":"1.1-1"},)"
+                                    R"({"name":"new-git","installed":"r1-1","aur":"r2-1"},)"
+                                    R"({"name":"quote\"d","installed":"1-1","aur":"2-1"}])"
+                                    "\n"));
+
+        // nothing to update
+        REQUIRE(formatUpdates({ candidates[2] }, false, false, output) == 2);
+        REQUIRE(output.empty());
+        REQUIRE(formatUpdates({}, false, true, output) == 2);
+        REQUIRE_THAT(output, Equals("[]\n"));
+
+        // the AUR couldn't be reached
+        REQUIRE(formatUpdates(candidates, true, false, output) == 1);
+        REQUIRE(output.empty());
+        REQUIRE(formatUpdates(candidates, true, true, output) == 1);
+        REQUIRE(output.empty());
+    }
+
+    SECTION("Installed AUR packages cache")
+    {
+        config->cacheDir      = "/tmp/taur_test_foreign";
+        config->readOnly      = false;
+        config->dbStateAtLoad = "local 1 core 2";
+        std::filesystem::remove_all(config->cacheDir);
+        std::filesystem::create_directories(config->cacheDir);
+
+        const std::vector<TaurPkg_t> pkgs{ { .name = "yay", .version = "12.3.5-1" },
+                                           { .name = "foo-git", .version = "1:r10.abc-2" } };
+
+        REQUIRE_FALSE(readForeignPkgsCache(config->dbStateAtLoad));
+
+        // the dbs changed since libalpm read them, what it found is older than the key
+        REQUIRE_FALSE(writeForeignPkgsCache("local 3 core 2", pkgs));
+        REQUIRE_FALSE(std::filesystem::exists(config->cacheDir / ".foreign-pkgs"));
+
+        config->readOnly = true;
+        REQUIRE_FALSE(writeForeignPkgsCache(config->dbStateAtLoad, pkgs));
+        REQUIRE_FALSE(std::filesystem::exists(config->cacheDir / ".foreign-pkgs"));
+        config->readOnly = false;
+
+        REQUIRE(writeForeignPkgsCache(config->dbStateAtLoad, pkgs));
+
+        const std::optional<std::vector<TaurPkg_t>>& cached = readForeignPkgsCache(config->dbStateAtLoad);
+        REQUIRE(cached);
+        REQUIRE(names(*cached) == names(pkgs));
+        REQUIRE_THAT((*cached)[1].version, Equals("1:r10.abc-2"));
+        REQUIRE((*cached)[1].installed);
+
+        // a stale key is ignored
+        REQUIRE_FALSE(readForeignPkgsCache("local 3 core 2"));
+
+        // no AUR package installed is cached too
+        REQUIRE(writeForeignPkgsCache(config->dbStateAtLoad, {}));
+        const std::optional<std::vector<TaurPkg_t>>& none = readForeignPkgsCache(config->dbStateAtLoad);
+        REQUIRE(none);
+        REQUIRE(none->empty());
+    }
+
+    SECTION("RPC responses")
+    {
+        RpcHandler search(false, false, false);
+        REQUIRE(parseRpcString(SEARCH_RESPONSE, search));
+        REQUIRE(search.resultcount == 1);
+        REQUIRE(search.type == "search");
+        REQUIRE(search.pkgs.size() == 1);
+        REQUIRE_THAT(search.pkgs[0].name, Equals("yay"));
+        REQUIRE_THAT(search.pkgs[0].version, Equals("12.3.5-1"));
+        REQUIRE_THAT(search.pkgs[0].desc, Equals("Yet another yogurt"));
+        REQUIRE_THAT(search.pkgs[0].aur_url, Equals(AUR_URL "/cgit/aur.git/snapshot/yay.tar.gz"));
+        REQUIRE(search.pkgs[0].maintainer == "jguer");
+        REQUIRE(search.pkgs[0].votes == 2000);
+        REQUIRE(search.pkgs[0].popularity == 40.5f);
+        REQUIRE(search.pkgs[0].outofdate == 0);
+        REQUIRE(search.pkgs[0].last_modified == 1700000000);
+        REQUIRE(search.pkgs[0].totaldepends.empty());
+
+        RpcHandler info(true, false, false);
+        REQUIRE(parseRpcString(INFO_RESPONSE, info));
+        REQUIRE(info.resultcount == 2);
+        REQUIRE(info.pkgs.size() == 2);
+
+        const TaurPkg_t& yay = info.pkgs[0];
+        REQUIRE_THAT(yay.aur_url, Equals(AUR_URL_GIT("yay")));
+        REQUIRE(std::vector(yay.depends().begin(), yay.depends().end()) ==
+                std::vector<std::string_view>{ "pacman>6.1", "git" });
+        REQUIRE(std::vector(yay.makedepends().begin(), yay.makedepends().end()) ==
+                std::vector<std::string_view>{ "go>=1.21" });
+        REQUIRE(yay.licenses == std::vector<std::string_view>{ "GPL-3.0-or-later" });
+
+        const TaurPkg_t& yayBin = info.pkgs[1];
+        REQUIRE(yayBin.maintainer == "\1");  // orphaned
+        REQUIRE(yayBin.outofdate == 1710000000);
+        REQUIRE(yayBin.totaldepends.empty());
+        REQUIRE(yayBin.licenses == std::vector<std::string_view>{ "GPL-3.0-or-later", "MIT" });
+
+        RpcHandler error(false, false, false);
+        REQUIRE(parseRpcString(
+            R"({"error":"Too many package results.","resultcount":0,"results":[],"type":"error","version":5})", error));
+        REQUIRE(error.type == "error");
+        REQUIRE(error.error == "Too many package results.");
+        REQUIRE(error.pkgs.empty());
+    }
+
+    SECTION("Unknown RPC fields")
+    {
+        RpcHandler handler(false, false, false);
+        REQUIRE(parseRpcString(UNKNOWN_FIELDS_RESPONSE, handler));
+        REQUIRE(handler.resultcount == 1);
+        REQUIRE(handler.pkgs.size() == 1);
+        REQUIRE_THAT(handler.pkgs[0].name, Equals("foo"));
+        REQUIRE_THAT(handler.pkgs[0].version, Equals("1-1"));
+        REQUIRE(handler.pkgs[0].totaldepends == std::vector<std::string_view>{ "bar" });
+    }
+
+    SECTION("Broken RPC responses")
+    {
+        RpcHandler truncated(false, false, false);
+        REQUIRE_FALSE(parseRpcString(INFO_RESPONSE.substr(0, INFO_RESPONSE.size() / 2), truncated));
+
+        RpcHandler notRpc(false, false, false);
+        REQUIRE_FALSE(parseRpcString(R"({"results":[]})", notRpc));
+
+        RpcHandler negative(false, false, false);
+        REQUIRE_FALSE(parseRpcString(R"({"resultcount":-1,"results":[]})", negative));
+    }
+
+    SECTION("RPC cache files")
+    {
+        config->cacheDir    = "/tmp/taur_test_rpc";
+        config->rpcCacheTTL = 300;
+        config->readOnly    = false;
+        std::filesystem::remove_all(config->cacheDir);
+
+        // each package is cached on its own, out of the record kept from the response
+        RpcHandler info(false, false, true);
+        REQUIRE(parseRpcString(INFO_RESPONSE, info));
+        REQUIRE(info.records.size() == 2);
+
+        const path& cachePath = getRpcCachePath("yay");
+        REQUIRE(cachePath == "/tmp/taur_test_rpc/.rpc/yay.json");
+
+        const std::time_t before = std::time(nullptr);
+        writeRpcCache(cachePath, fmt::format("{{\"resultcount\":1,\"results\":[{}]}}", info.records[0]));
+
+        RpcHandler cached(false, true, false);
+        REQUIRE(readRpcCache(cachePath, cached));
+        REQUIRE(cached.fetchedAt >= before);
+        REQUIRE(isRpcCacheFresh(cached));
+        REQUIRE(cached.resultcount == 1);
+        REQUIRE(cached.pkgs.size() == 1);
+        REQUIRE_THAT(cached.pkgs[0].name, Equals(info.pkgs[0].name));
+        REQUIRE_THAT(cached.pkgs[0].desc, Equals(info.pkgs[0].desc));
+        REQUIRE_THAT(cached.pkgs[0].aur_url, Equals(info.pkgs[0].aur_url));
+        REQUIRE(cached.pkgs[0].totaldepends == info.pkgs[0].totaldepends);
+        REQUIRE(cached.pkgs[0].dependsCount == info.pkgs[0].dependsCount);
+        REQUIRE(cached.pkgs[0].popularity == info.pkgs[0].popularity);
+
+        // a cache file isn't a response, and a response isn't a cache file
+        RpcHandler plain(false, false, false);
+        REQUIRE_FALSE(readRpcCache(cachePath, plain));
+
+        std::ofstream(getRpcCachePath("yay-bin")) << INFO_RESPONSE;
+        RpcHandler unwrapped(false, true, false);
+        REQUIRE_FALSE(readRpcCache(getRpcCachePath("yay-bin"), unwrapped));
+
+        RpcHandler missing(false, true, false);
+        REQUIRE_FALSE(readRpcCache(getRpcCachePath("nope"), missing));
+    }
+
+    SECTION("RPC cache of package info")
+    {
+        config->cacheDir        = "/tmp/taur_test_rpc";
+        config->rpcCacheTTL     = 300;
+        config->rpcMaxUrlLength = 4000;
+        config->localMetadata   = false;
+        config->readOnly        = false;
+        std::filesystem::remove_all(config->cacheDir);
+        std::filesystem::create_directories(config->cacheDir / ".rpc");
+
+        TaurBackend backend(*config);
+
+        // what writeRpcCache() writes, fetched at the given time
+        const auto& seed = [](const std::string_view name, const std::string_view version,
+                              const std::time_t fetchedAt) {
+            std::ofstream(getRpcCachePath(name)) << fmt::format(
+                R"({{"FetchedAt":{},"Data":{{"resultcount":1,"results":[{{"Name":"{}","Version":"{}"}}]}}}})",
+                fetchedAt, name, version);
+        };
+
+        bool failed = true;
+
+        // fresh entries never reach the AUR, these packages don't even exist there
+        seed("taur-test-fresh", "1.0-1", std::time(nullptr));
+        std::vector<TaurPkg_t> fresh = backend.fetch_pkgs({ "taur-test-fresh" }, false, &failed);
+        REQUIRE_FALSE(failed);
+        REQUIRE(fresh.size() == 1);
+        REQUIRE_THAT(fresh[0].version, Equals("1.0-1"));
+
+        // stale entries are asked again, and kept only when the AUR couldn't answer
+        seed("yay", "0-0", 0);
+        std::vector<TaurPkg_t> stale = backend.fetch_pkgs({ "yay" }, false, &failed);
+        REQUIRE(stale.size() == 1);
+        if (failed)
+            REQUIRE_THAT(stale[0].version, Equals("0-0"));
+        else
+        {
+            REQUIRE_THAT(stale[0].version, !Equals("0-0"));
+
+            RpcHandler revalidated(false, true, false);
+            REQUIRE(readRpcCache(getRpcCachePath("yay"), revalidated));
+            REQUIRE(isRpcCacheFresh(revalidated));
+        }
+
+        // one url per package, each failed batch falls back to the cache entries of its own packages
+        const std::vector<std::string> names{ "taur-test-a", "taur-test-b", "taur-test-c" };
+        for (const std::string& name : names)
+            seed(name, name, 0);
+
+        config->rpcMaxUrlLength = 1;
+        std::vector<TaurPkg_t> batches = backend.fetch_pkgs(names, false, &failed);
+        config->rpcMaxUrlLength = 4000;
+
+        if (failed)
+        {
+            REQUIRE(batches.size() == names.size());
+            for (const TaurPkg_t& pkg : batches)
+                REQUIRE_THAT(pkg.version, Equals(pkg.name));
+        }
+        else
+            REQUIRE(batches.empty());  // not on the AUR
+
+        // a TTL of 0 disables the cache
+        config->rpcCacheTTL = 0;
+        REQUIRE(backend.fetch_pkgs({ "taur-test-fresh" }, false).empty());
+
+        writeRpcCache(getRpcCachePath("taur-test-disabled"), R"({"resultcount":0,"results":[]})");
+        REQUIRE_FALSE(std::filesystem::exists(getRpcCachePath("taur-test-disabled")));
+
+        // and read-only runs don't write anything
+        config->rpcCacheTTL = 300;
+        config->readOnly    = true;
+        writeRpcCache(getRpcCachePath("taur-test-readonly"), R"({"resultcount":0,"results":[]})");
+        REQUIRE_FALSE(std::filesystem::exists(getRpcCachePath("taur-test-readonly")));
+        config->readOnly = false;
+    }
+}
@@ -30,4 +30,103 @@ TEST_CASE("util.cpp test suitcase", "[Util]")
         REQUIRE(expandVar(path) == env + "/.config/rule34");
         REQUIRE(shell_exec("echo hello") == "hello");
     }
+
+    SECTION("Running commands")
+    {
+        // more than a pipe can hold, it has to be read while it's printed
+        const ExecResult_t& big = capture_exec({ "head", "-c", "1000000", "/dev/zero" });
+        REQUIRE(big.success());
+        REQUIRE(big.out.size() == 1000000);
+
+        const ExecResult_t& failed = capture_exec({ "sh", "-c", "echo out; echo err >&2; exit 3" });
+        REQUIRE(failed.exitCode == 3);
+        REQUIRE_THAT(failed.out, Equals("out\n"));
+        REQUIRE_THAT(failed.err, Equals("err\n"));
+
+        const ExecResult_t& slow = capture_exec({ "sleep", "10" }, std::chrono::milliseconds(100));
+        REQUIRE(slow.timedOut);
+        REQUIRE_FALSE(slow.success());
+
+        // run somewhere else, without taur itself moving there
+        const path&         cwd   = std::filesystem::current_path();
+        const ExecResult_t& where =
+            capture_exec({ "sh", "-c", "pwd; echo $TAUR_TEST" }, {}, { "/", { "TAUR_TEST=hi" } });
+        REQUIRE_THAT(where.out, Equals("/\nhi\n"));
+        REQUIRE(std::filesystem::current_path() == cwd);
+        REQUIRE(getenv("TAUR_TEST") == nullptr);
+
+        std::filesystem::remove("/tmp/taur_test_exec.log");
+        REQUIRE(taur_exec({ "sh", "-c", "echo out; echo err >&2" }, false, { "/tmp" }, "/tmp/taur_test_exec.log"));
+        REQUIRE(std::filesystem::file_size("/tmp/taur_test_exec.log") == "out\nerr\n"_len);
+        REQUIRE_FALSE(taur_exec({ "taur-no-such-command" }, false));
+
+        std::string output;
+        REQUIRE(taur_read_exec({ "echo", "hello" }, output, false));
+        REQUIRE_THAT(output, Equals("hello\n"));
+        REQUIRE_FALSE(taur_read_exec({ "false" }, output, false));
+    }
+
+    SECTION("AUR list index")
+    {
+        std::ofstream("/tmp/taur_test_packages.aur") << "# AUR package list\nfoo\nbar\nbaz-git\nfoo\n";
+        REQUIRE(write_aur_index("/tmp/taur_test_packages.aur", "/tmp/taur_test_packages.aur.idx"));
+
+        AurList aur_list;
+        REQUIRE(aur_list.load("/tmp/taur_test_packages.aur.idx"));
+        REQUIRE(aur_list.size() == 3);
+        REQUIRE(aur_list.contains("baz-git"));
+        REQUIRE(aur_list.contains("foo"));
+        REQUIRE_FALSE(aur_list.contains("ba"));
+        REQUIRE_FALSE(aur_list.contains("# AUR package list"));
+    }
+
+    SECTION("AUR info urls")
+    {
+        const std::vector<std::string> pkgs{ "foo", "bar", "c++utilities", "baz" };
+
+        const auto& single = make_info_urls(pkgs, 4000);
+        REQUIRE(single.size() == 1);
+        REQUIRE(single[0].second == pkgs.size());
+        REQUIRE_THAT(single[0].first, Equals(AUR_RPC_INFO_URL
+                                             "arg%5B%5D=foo&arg%5B%5D=bar&arg%5B%5D=c%2B%2Butilities&arg%5B%5D=baz"));
+
+        // only room for one package per url
+        const auto& split = make_info_urls(pkgs, sizeof(AUR_RPC_INFO_URL "arg%5B%5D=foo&arg%5B%5D=bar") - 2);
+        REQUIRE(split.size() == pkgs.size());
+        for (size_t i = 0; i < split.size(); ++i)
+            REQUIRE(split[i].second == i + 1);
+
+        REQUIRE(make_info_urls({}, 4000).empty());
+
+        // every package is in exactly one url, in order
+        REQUIRE(info_url_range(single, 0) == std::pair<size_t, size_t>{ 0, pkgs.size() });
+        REQUIRE(info_url_range(split, 0) == std::pair<size_t, size_t>{ 0, 1 });
+        REQUIRE(info_url_range(split, 2) == std::pair<size_t, size_t>{ 2, 3 });
+        REQUIRE(info_url_range(split, 3) == std::pair<size_t, size_t>{ 3, 4 });
+
+        // foo and bar fit together, c++utilities gets its own, then baz
+        const auto& pairs = make_info_urls(pkgs, sizeof(AUR_RPC_INFO_URL "arg%5B%5D=foo&arg%5B%5D=bar") - 1);
+        REQUIRE(pairs.size() == 3);
+        REQUIRE(info_url_range(pairs, 0) == std::pair<size_t, size_t>{ 0, 2 });
+        REQUIRE(info_url_range(pairs, 1) == std::pair<size_t, size_t>{ 2, 3 });
+        REQUIRE(info_url_range(pairs, 2) == std::pair<size_t, size_t>{ 3, 4 });
+    }
+
+    SECTION("String interning")
+    {
+        const std::string_view mit = intern_str("MIT");
+        REQUIRE(mit == "MIT");
+        REQUIRE(mit.data()[mit.size()] == '\0');
+        REQUIRE(intern_str(std::string("MI") + "T").data() == mit.data());
+        REQUIRE(intern_str("GPL").data() != mit.data());
+    }
+
+    SECTION("Hashes")
+    {
+        REQUIRE(sha256_hex("abc") == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+        std::ofstream("/tmp/taur_test_hash") << "abc";
+        REQUIRE(sha256_file("/tmp/taur_test_hash") == sha256_hex("abc"));
+        REQUIRE(sha256_file("/tmp/taur_test_hash_missing").empty());
+    }
 }